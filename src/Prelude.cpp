@@ -15,6 +15,7 @@
 #include "datagen.h"
 #include "tunable.h"
 #include "searcher.h"
+#include "kernels.h"
 
 #ifdef _MSC_VER
     #define MSVC
@@ -29,6 +30,12 @@
     #undef MSVC
 #endif
 
+// incbin aligns to the widest vector the build targets, which is only 16 bytes for DISPATCH builds
+// The net is borrowed in place only when it is aligned like the weights, so always align it to a cache line
+#undef INCBIN_ALIGNMENT_INDEX
+#define INCBIN_ALIGNMENT_INDEX 6
+static_assert(1 << INCBIN_ALIGNMENT_INDEX == ALIGNMENT, "The embedded net must be aligned like the network weights");
+
 #if !defined(_MSC_VER) || defined(__clang__)
 INCBIN(EVAL, EVALFILE);
 #endif
@@ -44,16 +51,16 @@ bool nodesAreSoftNodes = false;
 int main(int argc, char* argv[]) {
     auto loadDefaultNet = [&]([[maybe_unused]] bool warnMSVC = false) {
 #if defined(_MSC_VER) && !defined(__clang__)
-        nnue.loadNetwork(EVALFILE);
         if (warnMSVC)
             cerr << "WARNING: This file was compiled with MSVC, this means that an nnue was NOT embedded into the exe." << endl;
+        return nnue.loadNetwork(EVALFILE);
 #else
-        nnue = *reinterpret_cast<const NNUE*>(gEVALData);
+        // Goes through the same checks as a file, and narrows the weights when QA selects i8 weights
+        // The embedded net lives in the executable's read-only pages, so it is used in place when the layout allows
+        return nnue.loadNetwork(gEVALData, gEVALSize, "internal", true);
 #endif
     };
 
-    loadDefaultNet(true);
-
     Board board;
 
     string              command;
@@ -63,12 +70,31 @@ int main(int argc, char* argv[]) {
     Board::fillZobristTable();
     Search::fillLmrTable();
 
+    // Multi layer nets are reordered on load using the bench positions, which need the move generation and Zobrist tables
+    Kernels::select();
+    if (!loadDefaultNet(true)) {
+        cerr << "The default network could not be loaded" << endl;
+        return 1;
+    }
+
     board.reset();
 
     Searcher searcher;
     
     TBManager tbManager;
 
+    string hashFile = "<empty>";
+    string evalFile   = "internal";
+    bool   evalShared = false;
+
+    auto loadEvalFile = [&]() {
+        searcher.waitForBackground();
+        const bool loaded = evalFile == "internal" ? loadDefaultNet() : nnue.loadNetwork(evalFile, evalShared);
+        if (loaded)
+            cout << "info string Loaded network " << evalFile << (nnue.isShared() ? " as a shared read-only mapping" : " as a private copy") << endl;
+        searcher.networkChanged();
+    };
+
     const auto exists            = [&](const string& str, const string& sub) { return str.find(" " + sub + " ") != string::npos; };
     const auto getValueFollowing = [&](const string& str, const string& value, const auto& defaultValue) {
         std::istringstream ss(str);
@@ -91,6 +117,8 @@ int main(int argc, char* argv[]) {
         string arg1 = argv[1];
         if (arg1 == "bench")
             Search::bench();
+        else if (arg1 == "microbench")
+            Search::microbench();
         else if (arg1 == "datagen") {
             usize threads = 1;
             if (argc >= 2)
@@ -132,8 +160,13 @@ int main(int argc, char* argv[]) {
             cout << "id author Quinniboi10" << endl;
             cout << "option name Threads type spin default 1 min 1 max 512" << endl;
             cout << "option name Hash type spin default 16 min 1 max 524288" << endl;
+            cout << "option name HashFile type string default <empty>" << endl;
+            cout << "option name SaveHash type button" << endl;
+            cout << "option name LoadHash type button" << endl;
+            cout << "option name HashShared type string default <empty>" << endl;
             cout << "option name Move Overhead type spin default 20 min 0 max 1000" << endl;
             cout << "option name EvalFile type string default internal" << endl;
+            cout << "option name EvalShared type check default false" << endl;
             cout << "option name SyzygyPath type string default <empty>" << endl;
             cout << "option name SyzygyProbeDepth type spin default 1 min 1 max " << MAX_PLY << endl;
             cout << "option name SyzygyProbeLimit type spin default 32 min 3 max 32 " << endl;
@@ -142,12 +175,16 @@ int main(int argc, char* argv[]) {
             #ifdef TUNE
             printTuneUCI();
             #endif
+            cout << "info string Using " << Kernels::active.name << " NNUE kernels" << endl;
             cout << "uciok" << endl;
         }
         else if (command == "ucinewgame")
             searcher.reset();
-        else if (command == "isready")
+        else if (command == "isready") {
+            // Only blocks while a clear or resize is still running
+            searcher.waitForBackground();
             cout << "readyok" << endl;
+        }
         else if (tokens[0] == "position") {
             if (tokens[1] == "startpos") {
                 board.reset();
@@ -195,14 +232,27 @@ int main(int argc, char* argv[]) {
             else if (tokens[2] == "Hash") {
                 searcher.resizeTT(std::stoi(tokens[findIndexOf(tokens, "value") + 1]));
             }
+            else if (tokens[2] == "HashFile")
+                hashFile = mergeFromIndex(tokens, findIndexOf(tokens, "value") + 1);
+            else if (tokens[2] == "SaveHash")
+                searcher.saveTT(hashFile);
+            else if (tokens[2] == "LoadHash")
+                searcher.loadTT(hashFile);
+            else if (tokens[2] == "HashShared")
+                searcher.shareTT(mergeFromIndex(tokens, findIndexOf(tokens, "value") + 1));
             else if (tokens[2] == "Move" && tokens[3] == "Overhead")
                 MOVE_OVERHEAD = std::stoi(tokens[findIndexOf(tokens, "value") + 1]);
             else if (tokens[2] == "EvalFile") {
-                string value = tokens[findIndexOf(tokens, "value") + 1];
-                if (value == "internal")
-                    loadDefaultNet();
-                else
-                    nnue.loadNetwork(value);
+                evalFile = tokens[findIndexOf(tokens, "value") + 1];
+                loadEvalFile();
+            }
+            else if (tokens[2] == "EvalShared") {
+                const bool share = tokens[findIndexOf(tokens, "value") + 1] == "true";
+                if (share != evalShared && evalFile != "internal") {
+                    evalShared = share;
+                    loadEvalFile();
+                }
+                evalShared = share;
             }
             else if (tokens[2] == "SyzygyPath")
                 tb::setPath(mergeFromIndex(tokens, findIndexOf(tokens, "value") + 1));
@@ -257,13 +307,36 @@ int main(int argc, char* argv[]) {
         }
         else if (command == "bench")
             Search::bench();
+        else if (command == "microbench")
+            Search::microbench();
+        else if (tokens[0] == "savehash")
+            searcher.saveTT(tokens.size() > 1 ? mergeFromIndex(tokens, 1) : hashFile);
+        else if (tokens[0] == "loadhash")
+            searcher.loadTT(tokens.size() > 1 ? mergeFromIndex(tokens, 1) : hashFile);
+        else if (tokens[0] == "savenet" && tokens.size() > 1)
+            nnue.saveNetwork(mergeFromIndex(tokens, 1));
+        else if (tokens[0] == "evalbatch" && tokens.size() > 2) {
+            searcher.waitForBackground();
+            Datagen::evalBatch(tokens[1], tokens[2], tokens.size() > 3 ? std::stoi(tokens[3]) : 1);
+        }
         else if (tokens[0] == "datagen")
             Datagen::run(tokens.size() > 1 ? std::stoi(tokens[1]) : 1);
         else if (command == "debug.eval") {
+            searcher.waitForBackground();
             searcher.mainData->refresh(board);
             cout << "Raw eval: " << nnue.forwardPass(&board, searcher.mainData->accumulatorStack.top()) << endl;
             nnue.showBuckets(&board, searcher.mainData->accumulatorStack.top());
         }
+        else if (command == "debug.kernels")
+            Kernels::verify(nnue.weights->weightsToHL.data());
+        else if (command == "debug.ttstats") {
+#ifdef TT_STATS
+            searcher.waitForBackground();
+            cout << searcher.ttStatsReport() << endl;
+#else
+            cout << "TT stats are compiled out, define TT_STATS in config.h" << endl;
+#endif
+        }
         else if (command == "debug.moves") {
             MoveList moves = Movegen::generateMoves<ALL_MOVES>(board);
             for (Move m : moves) {
@@ -2,40 +2,75 @@
 #include "globals.h"
 #include "nnue.h"
 #include "board.h"
+#include "kernels.h"
 
 void AccumulatorPair::resetAccumulators(const Board& board) {
-    u64 whitePieces = board.pieces(WHITE);
-    u64 blackPieces = board.pieces(BLACK);
-
-    white = nnue.hiddenLayerBias;
-    black = nnue.hiddenLayerBias;
-
-    while (whitePieces) {
-        Square sq = popLSB(whitePieces);
-
-        usize whiteInputFeature = NNUE::feature(WHITE, WHITE, board.getPiece(sq), sq);
-        usize blackInputFeature = NNUE::feature(BLACK, WHITE, board.getPiece(sq), sq);
-
-        for (usize i = 0; i < HL_SIZE; i++) {
-            white[i] += nnue.weightsToHL[whiteInputFeature * HL_SIZE + i];
-            black[i] += nnue.weightsToHL[blackInputFeature * HL_SIZE + i];
+    for (Color perspective : {WHITE, BLACK}) {
+        array<u16, 32> features;
+        usize          featureCount = 0;
+
+        for (Color color : {WHITE, BLACK}) {
+            u64 pieces = board.pieces(color);
+            while (pieces) {
+                const Square sq          = popLSB(pieces);
+                features[featureCount++] = NNUE::feature(perspective, color, board.getPiece(sq), sq);
+            }
         }
+
+        Accumulator& accumulator = perspective == WHITE ? white : black;
+        accumulator              = nnue.weights->hiddenLayerBias;
+        Kernels::active.applyRows(accumulator.data(), accumulator.data(), nnue.weights->weightsToHL.data(), features.data(), featureCount, nullptr, 0);
     }
 
-    while (blackPieces) {
-        Square sq = popLSB(blackPieces);
+    computed = true;
+}
 
-        usize whiteInputFeature = NNUE::feature(WHITE, BLACK, board.getPiece(sq), sq);
-        usize blackInputFeature = NNUE::feature(BLACK, BLACK, board.getPiece(sq), sq);
+void RefreshCache::reset() {
+    for (Entry& entry : entries) {
+        entry.accumulator = nnue.weights->hiddenLayerBias;
+        deepFill(entry.pieces, 0);
+    }
+}
 
-        for (usize i = 0; i < HL_SIZE; i++) {
-            white[i] += nnue.weightsToHL[whiteInputFeature * HL_SIZE + i];
-            black[i] += nnue.weightsToHL[blackInputFeature * HL_SIZE + i];
+void RefreshCache::refresh(const Board& board, AccumulatorPair& accumulators) {
+    for (Color perspective : {WHITE, BLACK}) {
+        Entry& entry = entries[perspective];
+
+        // Each piece can only be added or removed once, so neither list can outgrow the 32 pieces
+        array<u16, 32> adds;
+        array<u16, 32> subs;
+        usize          addCount = 0;
+        usize          subCount = 0;
+
+        for (Color color : {WHITE, BLACK}) {
+            for (PieceType pt = PAWN; pt <= KING; pt = static_cast<PieceType>(pt + 1)) {
+                const u64 current = board.pieces(color, pt);
+                u64       added   = current & ~entry.pieces[color][pt];
+                u64       removed = entry.pieces[color][pt] & ~current;
+
+                while (added) {
+                    const Square sq  = popLSB(added);
+                    adds[addCount++] = NNUE::feature(perspective, color, pt, sq);
+                }
+                while (removed) {
+                    const Square sq  = popLSB(removed);
+                    subs[subCount++] = NNUE::feature(perspective, color, pt, sq);
+                }
+
+                entry.pieces[color][pt] = current;
+            }
         }
+
+        Kernels::active.applyRows(entry.accumulator.data(), entry.accumulator.data(), nnue.weights->weightsToHL.data(), adds.data(), addCount, subs.data(), subCount);
+        (perspective == WHITE ? accumulators.white : accumulators.black) = entry.accumulator;
     }
+
+    accumulators.computed = true;
 }
 
 void AccumulatorPair::update(const Board& board, const Move m, const PieceType toPT) {
+    computed = false;
+
     const Color     stm   = ~board.stm;
     const Square    from  = m.from();
     const Square    to    = m.to();
@@ -55,53 +90,63 @@ void AccumulatorPair::update(const Board& board, const Move m, const PieceType t
         addSub(stm, to, endPT, from, pt);
 }
 
+void AccumulatorPair::updateNull() {
+    computed       = false;
+    delta.addCount = 0;
+    delta.subCount = 0;
+}
+
+void AccumulatorPair::materialize(const AccumulatorPair& parent) {
+    assert(parent.computed);
+    assert(!aliasesParent());
+
+    Kernels::active.applyRows(parent.white.data(), white.data(), nnue.weights->weightsToHL.data(), delta.adds[WHITE].data(), delta.addCount, delta.subs[WHITE].data(), delta.subCount);
+    Kernels::active.applyRows(parent.black.data(), black.data(), nnue.weights->weightsToHL.data(), delta.adds[BLACK].data(), delta.addCount, delta.subs[BLACK].data(), delta.subCount);
+
+    computed = true;
+}
+
 // All friendly, for quiets
 void AccumulatorPair::addSub(Color stm, Square add, PieceType addPT, Square sub, PieceType subPT) {
-    int addW = NNUE::feature(WHITE, stm, addPT, add);
-    int addB = NNUE::feature(BLACK, stm, addPT, add);
+    delta.adds[WHITE][0] = NNUE::feature(WHITE, stm, addPT, add);
+    delta.adds[BLACK][0] = NNUE::feature(BLACK, stm, addPT, add);
 
-    int subW = NNUE::feature(WHITE, stm, subPT, sub);
-    int subB = NNUE::feature(BLACK, stm, subPT, sub);
+    delta.subs[WHITE][0] = NNUE::feature(WHITE, stm, subPT, sub);
+    delta.subs[BLACK][0] = NNUE::feature(BLACK, stm, subPT, sub);
 
-    for (usize i = 0; i < HL_SIZE; i++) {
-        white[i] += nnue.weightsToHL[addW * HL_SIZE + i] - nnue.weightsToHL[subW * HL_SIZE + i];
-        black[i] += nnue.weightsToHL[addB * HL_SIZE + i] - nnue.weightsToHL[subB * HL_SIZE + i];
-    }
+    delta.addCount = 1;
+    delta.subCount = 1;
 }
 
 // Captures
 void AccumulatorPair::addSubSub(Color stm, Square add, PieceType addPT, Square sub1, PieceType subPT1, Square sub2, PieceType subPT2) {
-    int addW = NNUE::feature(WHITE, stm, addPT, add);
-    int addB = NNUE::feature(BLACK, stm, addPT, add);
+    delta.adds[WHITE][0] = NNUE::feature(WHITE, stm, addPT, add);
+    delta.adds[BLACK][0] = NNUE::feature(BLACK, stm, addPT, add);
 
-    int subW1 = NNUE::feature(WHITE, stm, subPT1, sub1);
-    int subB1 = NNUE::feature(BLACK, stm, subPT1, sub1);
+    delta.subs[WHITE][0] = NNUE::feature(WHITE, stm, subPT1, sub1);
+    delta.subs[BLACK][0] = NNUE::feature(BLACK, stm, subPT1, sub1);
 
-    int subW2 = NNUE::feature(WHITE, ~stm, subPT2, sub2);
-    int subB2 = NNUE::feature(BLACK, ~stm, subPT2, sub2);
+    delta.subs[WHITE][1] = NNUE::feature(WHITE, ~stm, subPT2, sub2);
+    delta.subs[BLACK][1] = NNUE::feature(BLACK, ~stm, subPT2, sub2);
 
-    for (usize i = 0; i < HL_SIZE; i++) {
-        white[i] += nnue.weightsToHL[addW * HL_SIZE + i] - nnue.weightsToHL[subW1 * HL_SIZE + i] - nnue.weightsToHL[subW2 * HL_SIZE + i];
-        black[i] += nnue.weightsToHL[addB * HL_SIZE + i] - nnue.weightsToHL[subB1 * HL_SIZE + i] - nnue.weightsToHL[subB2 * HL_SIZE + i];
-    }
+    delta.addCount = 1;
+    delta.subCount = 2;
 }
 
 // Castling
 void AccumulatorPair::addAddSubSub(Color stm, Square add1, PieceType addPT1, Square add2, PieceType addPT2, Square sub1, PieceType subPT1, Square sub2, PieceType subPT2) {
-    int addW1 = NNUE::feature(WHITE, stm, addPT1, add1);
-    int addB1 = NNUE::feature(BLACK, stm, addPT1, add1);
+    delta.adds[WHITE][0] = NNUE::feature(WHITE, stm, addPT1, add1);
+    delta.adds[BLACK][0] = NNUE::feature(BLACK, stm, addPT1, add1);
 
-    int addW2 = NNUE::feature(WHITE, stm, addPT2, add2);
-    int addB2 = NNUE::feature(BLACK, stm, addPT2, add2);
+    delta.adds[WHITE][1] = NNUE::feature(WHITE, stm, addPT2, add2);
+    delta.adds[BLACK][1] = NNUE::feature(BLACK, stm, addPT2, add2);
 
-    int subW1 = NNUE::feature(WHITE, stm, subPT1, sub1);
-    int subB1 = NNUE::feature(BLACK, stm, subPT1, sub1);
+    delta.subs[WHITE][0] = NNUE::feature(WHITE, stm, subPT1, sub1);
+    delta.subs[BLACK][0] = NNUE::feature(BLACK, stm, subPT1, sub1);
 
-    int subW2 = NNUE::feature(WHITE, stm, subPT2, sub2);
-    int subB2 = NNUE::feature(BLACK, stm, subPT2, sub2);
+    delta.subs[WHITE][1] = NNUE::feature(WHITE, stm, subPT2, sub2);
+    delta.subs[BLACK][1] = NNUE::feature(BLACK, stm, subPT2, sub2);
 
-    for (usize i = 0; i < HL_SIZE; i++) {
-        white[i] += nnue.weightsToHL[addW1 * HL_SIZE + i] + nnue.weightsToHL[addW2 * HL_SIZE + i] - nnue.weightsToHL[subW1 * HL_SIZE + i] - nnue.weightsToHL[subW2 * HL_SIZE + i];
-        black[i] += nnue.weightsToHL[addB1 * HL_SIZE + i] + nnue.weightsToHL[addB2 * HL_SIZE + i] - nnue.weightsToHL[subB1 * HL_SIZE + i] - nnue.weightsToHL[subB2 * HL_SIZE + i];
-    }
+    delta.addCount = 2;
+    delta.subCount = 2;
 }
\ No newline at end of file
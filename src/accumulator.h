@@ -4,19 +4,58 @@
 #include "config.h"
 #include "move.h"
 
+// Enough for every instruction set, builds with DISPATCH hold AVX-512 kernels whatever the baseline is
+constexpr usize ALIGNMENT = 64;
+
 using Accumulator = array<i16, HL_SIZE>;
 
+// The feature rows a move adds and removes, indexed [perspective][row]
+struct FeatureDelta {
+    MultiArray<u16, 2, 2> adds;
+    MultiArray<u16, 2, 2> subs;
+    u8                    addCount;
+    u8                    subCount;
+};
+
 struct AccumulatorPair {
-    alignas(32) Accumulator white;
-    alignas(32) Accumulator black;
+    // Aligned to the widest vector, the kernels use aligned loads and stores
+    alignas(ALIGNMENT) Accumulator white;
+    alignas(ALIGNMENT) Accumulator black;
+
+    // Moves only record their delta, the accumulators are computed from the parent's once an evaluation needs them
+    FeatureDelta delta;
+    bool         computed;
 
     void resetAccumulators(const Board& board);
 
+    // Records the delta of the move, leaving the accumulators stale
     void update(const Board& board, const Move m, const PieceType toPT);
+    // A null move has no delta. Its entry is never computed, it stands in for the nearest real ancestor
+    void updateNull();
+    bool aliasesParent() const { return delta.addCount == 0; }
+    // Writes the parent's accumulators plus the recorded delta, in one pass over each
+    void materialize(const AccumulatorPair& parent);
 
     void addSub(Color stm, Square add, PieceType addPT, Square sub, PieceType subPT);
     void addSubSub(Color stm, Square add, PieceType addPT, Square sub1, PieceType subPT1, Square sub2, PieceType subPT2);
     void addAddSubSub(Color stm, Square add1, PieceType addPT1, Square add2, PieceType addPT2, Square sub1, PieceType subPT1, Square sub2, PieceType subPT2);
 
     bool operator==(const AccumulatorPair& other) const { return white == other.white && black == other.black; }
+};
+
+// Remembers the accumulator each perspective was last refreshed to along with the pieces in it,
+// so a refresh only applies the pieces that differ instead of rebuilding from the bias
+struct RefreshCache {
+    struct Entry {
+        alignas(ALIGNMENT) Accumulator accumulator;
+        // Indexed [color][piece type]
+        MultiArray<u64, 2, 6> pieces;
+    };
+
+    // Indexed [perspective]
+    array<Entry, 2> entries;
+
+    // Must be called again whenever the network changes
+    void reset();
+    void refresh(const Board& board, AccumulatorPair& accumulators);
 };
\ No newline at end of file
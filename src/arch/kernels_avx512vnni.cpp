@@ -0,0 +1,3 @@
+// Compiled with the flags for this instruction set when building with DISPATCH, see the makefile
+#define KERNEL_TABLE Kernels::AVX512_VNNI
+#include "../kernels.tpp"
\ No newline at end of file
@@ -2,9 +2,16 @@
 
 #include "types.h"
 
+#include <limits>
+#include <type_traits>
+
 // ************ TUNING ************
 // #define TUNE
 
+// ************ DEBUGGING ************
+// Counts TT probes, hits, collisions and refused stores per thread, reported with debug.ttstats
+// #define TT_STATS
+
 // ************ SEARCH ************
 constexpr usize MAX_PLY     = 255;
 constexpr i16   BENCH_DEPTH = 12;
@@ -18,6 +25,22 @@ constexpr i16    EVAL_SCALE     = 400;
 constexpr size_t HL_SIZE        = 1024;
 constexpr size_t OUTPUT_BUCKETS = 8;
 
+// Dense layers after the feature transformer, making the net (768->HL_SIZE)x2->L2_SIZE->L3_SIZE->1xOUTPUT_BUCKETS
+// The feature transformer output is clipped to [0, QA] and read sparsely by the first of them, which is quantised by
+// QL1. The later layers run in float with SCReLU. Leave L2_SIZE at 0 for the single layer net
+constexpr size_t L2_SIZE = 0;
+constexpr size_t L3_SIZE = 32;
+constexpr i16    QL1     = 64;
+
+// Trainers clip the feature transformer weights to this before scaling them by QA
+constexpr double FT_WEIGHT_CLIP = 1.98;
+// A QA small enough that every clipped input weight fits in a byte stores them as i8, halving their footprint
+// Loading still checks every weight and rejects a net that doesn't fit
+constexpr bool FT_I8 = QA * FT_WEIGHT_CLIP <= std::numeric_limits<i8>::max();
+
+using FTWeight = std::conditional_t<FT_I8, i8, i16>;
+static_assert(!FT_I8 || QA * FT_WEIGHT_CLIP <= std::numeric_limits<FTWeight>::max(), "QA is too large for i8 feature transformer weights");
+
 constexpr int ReLU   = 0;
 constexpr int CReLU  = 1;
 constexpr int SCReLU = 2;
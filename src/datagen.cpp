@@ -4,6 +4,8 @@
 #include "search.h"
 #include "constants.h"
 #include "thread.h"
+#include "numa.h"
+#include "globals.h"
 
 #include "../external/fmt/fmt/format.h"
 
@@ -73,6 +75,61 @@ struct MarlinFormat {
             occ &= occ - 1;
         }
     }
+
+    // Datagen only plays standard chess, so castling rights come from unmoved rooks in the corners
+    string fen() const {
+        constexpr char PIECE_CHARS[] = "pnbrqkr";
+
+        array<char, 64> squares;
+        squares.fill(0);
+
+        string castling;
+        u64    occ   = occupancy;
+        usize  index = 0;
+        while (occ) {
+            const Square sq    = Square(ctzll(occ));
+            const u8     piece = pieces[index++];
+            const bool   black = piece & (1 << 3);
+            const char   pc    = PIECE_CHARS[piece & 0b111];
+
+            squares[sq] = black ? pc : std::toupper(pc);
+            if ((piece & 0b111) == 6)
+                castling += sq == h1 ? "K" : sq == a1 ? "Q" : sq == h8 ? "k" : sq == a8 ? "q" : "";
+
+            occ &= occ - 1;
+        }
+
+        string fen;
+        for (i32 rank = 7; rank >= 0; rank--) {
+            usize empty = 0;
+            for (usize file = 0; file < 8; file++) {
+                const char pc = squares[rank * 8 + file];
+                if (pc == 0) {
+                    empty++;
+                    continue;
+                }
+                if (empty > 0)
+                    fen += std::to_string(empty);
+                empty = 0;
+                fen += pc;
+            }
+            if (empty > 0)
+                fen += std::to_string(empty);
+            if (rank > 0)
+                fen += '/';
+        }
+
+        // Castling rights have to be in KQkq order
+        std::sort(castling.begin(), castling.end(), [](char a, char b) { return string("KQkq").find(a) < string("KQkq").find(b); });
+
+        const usize ep = epSquare & 0x7F;
+        fen += (epSquare & (1 << 7)) ? " b " : " w ";
+        fen += castling.empty() ? "-" : castling;
+        fen += ' ';
+        fen += ep == 64 ? string("-") : squareToAlgebraic(Square(ep));
+        fen += fmt::format(" {} {}", halfmoveClock, fullmoveClock);
+        return fen;
+    }
 };
 
 struct Game {
@@ -140,6 +197,9 @@ void writeToFile(std::ofstream& outFile, const std::vector<Game>& data) {
 
 
 void runThread(int id) {
+    // The thread's search data and TT are first touched below, so bind before allocating them
+    Numa::bindThread(id);
+
     string filePath = "./data/" + makeFileName();
 
     if (!std::filesystem::is_directory("./data/"))
@@ -256,4 +316,77 @@ void Datagen::genFens(u64 numFens, u64 seed) {
         cout << "info string genfens " << board.fen() << endl;
         fens++;
     }
+}
+
+void Datagen::evalBatch(const string& input, const string& output, usize threadCount) {
+    std::ifstream inFile(input, std::ios::binary);
+    if (!inFile.is_open()) {
+        cout << "info string Could not open " << input << endl;
+        return;
+    }
+
+    std::ofstream outFile(output, std::ios::trunc);
+    if (!outFile.is_open()) {
+        cout << "info string Could not open " << output << " for writing" << endl;
+        return;
+    }
+
+    std::vector<Board> boards;
+    std::vector<i32>   scores;
+    usize              positions = 0;
+
+    Stopwatch<std::chrono::milliseconds> time;
+
+    boards.reserve(EVAL_BATCH_POSITIONS);
+
+    auto flush = [&]() {
+        nnue.evaluateBatch(boards, scores, threadCount);
+        for (usize i = 0; i < boards.size(); i++)
+            outFile << boards[i].fen() << " | " << (boards[i].stm == WHITE ? scores[i] : -scores[i]) << "\n";
+        positions += boards.size();
+        boards.clear();
+    };
+
+    auto addBoard = [&](const Board& board) {
+        boards.push_back(board);
+        if (boards.size() >= EVAL_BATCH_POSITIONS)
+            flush();
+    };
+
+    if (input.ends_with(".preludedata")) {
+        MarlinFormat header;
+        ScoredMove   scored(Move::null(), 0);
+        Board        board;
+
+        // Every scored move was played from a position the datagen search evaluated, so those are the ones rescored
+        while (inFile.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+            board.loadFromFEN(header.fen());
+            while (inFile.read(reinterpret_cast<char*>(&scored), sizeof(scored)) && scored.move != 0) {
+                // The history is only needed for repetitions, dropping it keeps the copies cheap
+                board.posHistory.clear();
+                addBoard(board);
+
+                board.move(std::bit_cast<Move>(scored.move));
+            }
+        }
+    }
+    else {
+        string line;
+        Board  board;
+        while (std::getline(inFile, line)) {
+            // Anything after the FEN, such as a score or a result, is ignored
+            line = line.substr(0, line.find_first_of("|;["));
+            if (line.find_first_not_of(" \t\r") == string::npos)
+                continue;
+            board.loadFromFEN(line);
+            board.posHistory.clear();
+            addBoard(board);
+        }
+    }
+
+    if (!boards.empty())
+        flush();
+
+    cout << "info string Evaluated " << formatNum(positions) << " positions in " << formatTime(time.elapsed()) << " at "
+         << fmt::format("{:.0f}", positions * 1000 / std::max<double>(time.elapsed(), 1)) << " pos/s" << endl;
 }
\ No newline at end of file
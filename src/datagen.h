@@ -8,6 +8,11 @@ constexpr usize RAND_MOVES          = 8;
 constexpr u64   SOFT_NODES          = 5000;
 constexpr u64   HARD_NODES          = 100'000;
 
+// Positions read in before each round of batched evaluation
+constexpr usize EVAL_BATCH_POSITIONS = 1 << 16;
+
 void run(usize threads);
 void genFens(u64 numFens, u64 seed);
+// Writes "<fen> | <eval>" for every position in a FEN list or .preludedata file, with evals from white's view
+void evalBatch(const string& input, const string& output, usize threadCount);
 }
\ No newline at end of file
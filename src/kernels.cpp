@@ -0,0 +1,134 @@
+#define KERNEL_TABLE Kernels::BASELINE
+#include "kernels.tpp"
+#include "accumulator.h"
+
+#include <random>
+
+namespace Kernels {
+Table active = BASELINE;
+
+void select() {
+#if defined(DISPATCH) && (defined(__GNUC__) || defined(__clang__))
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512vnni") && __builtin_cpu_supports("avx512bw"))
+        active = AVX512_VNNI;
+    else if (__builtin_cpu_supports("avx512bw"))
+        active = AVX512;
+    else if (__builtin_cpu_supports("avxvnni") && __builtin_cpu_supports("avx2"))
+        active = AVX_VNNI;
+    else if (__builtin_cpu_supports("avx2"))
+        active = AVX2;
+    else
+        active = BASELINE;
+#else
+    active = BASELINE;
+#endif
+}
+
+void verify(const FTWeight* weights) {
+    std::vector<const Table*> tables = {&BASELINE};
+#if defined(DISPATCH) && (defined(__GNUC__) || defined(__clang__))
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        tables.push_back(&AVX2);
+    if (__builtin_cpu_supports("avxvnni") && __builtin_cpu_supports("avx2"))
+        tables.push_back(&AVX_VNNI);
+    if (__builtin_cpu_supports("avx512bw"))
+        tables.push_back(&AVX512);
+    if (__builtin_cpu_supports("avx512vnni") && __builtin_cpu_supports("avx512bw"))
+        tables.push_back(&AVX512_VNNI);
+#endif
+
+    constexpr usize TRIALS = 10000;
+
+    // The last BATCH_SIZE trials are kept around to check the batched output layer on
+    alignas(ALIGNMENT) static MultiArray<i16, BATCH_SIZE, HL_SIZE> stms;
+    alignas(ALIGNMENT) static MultiArray<i16, BATCH_SIZE, HL_SIZE> nstms;
+    alignas(ALIGNMENT) static array<i16, HL_SIZE * 2>              outputWeights;
+    alignas(ALIGNMENT) static array<i16, HL_SIZE>                  expected;
+    alignas(ALIGNMENT) static array<i16, HL_SIZE>                  actual;
+    alignas(ALIGNMENT) static array<i16, HL_SIZE * 2 * L2_SIZE>    l1Weights;
+
+    for (const Table* table : tables) {
+        // Same seed for every table, so they all see the same inputs
+        std::mt19937_64 engine(0xC0FFEE);
+
+        // Accumulators reach a little past both clamp bounds, weights stay within what the output layer can hold
+        std::uniform_int_distribution<int> accumulatorDist(-QA / 4, QA + QA / 4);
+        std::uniform_int_distribution<int> weightDist(-QB * 2, QB * 2);
+        std::uniform_int_distribution<int> featureDist(0, 767);
+        std::uniform_int_distribution<int> countDist(0, 4);
+
+        usize screluMismatches = 0;
+        usize batchMismatches  = 0;
+        usize rowMismatches    = 0;
+        usize l1Mismatches     = 0;
+
+        for (usize trial = 0; trial < TRIALS; trial++) {
+            array<i16, HL_SIZE>& stm  = stms[trial % BATCH_SIZE];
+            array<i16, HL_SIZE>& nstm = nstms[trial % BATCH_SIZE];
+
+            // The output weights only change once a batch has been checked, so every batch shares them
+            const bool newBatch = trial % BATCH_SIZE == 0;
+            for (usize i = 0; i < HL_SIZE; i++) {
+                stm[i]  = accumulatorDist(engine);
+                nstm[i] = accumulatorDist(engine);
+                if (newBatch) {
+                    outputWeights[i]           = weightDist(engine);
+                    outputWeights[i + HL_SIZE] = weightDist(engine);
+                }
+            }
+
+            if (table->screlu(stm.data(), nstm.data(), outputWeights.data()) != SCALAR.screlu(stm.data(), nstm.data(), outputWeights.data()))
+                screluMismatches++;
+
+            if (trial % BATCH_SIZE == BATCH_SIZE - 1) {
+                // Cycle through every batch size, so each of the fixed size paths gets used
+                const usize count = trial / BATCH_SIZE % BATCH_SIZE + 1;
+
+                array<const i16*, BATCH_SIZE> stmPointers;
+                array<const i16*, BATCH_SIZE> nstmPointers;
+                array<i32, BATCH_SIZE>        outputs;
+                for (usize b = 0; b < count; b++) {
+                    stmPointers[b]  = stms[b].data();
+                    nstmPointers[b] = nstms[b].data();
+                }
+
+                table->screluBatch(stmPointers.data(), nstmPointers.data(), outputWeights.data(), count, outputs.data());
+                for (usize b = 0; b < count; b++)
+                    batchMismatches += outputs[b] != SCALAR.screlu(stms[b].data(), nstms[b].data(), outputWeights.data());
+            }
+
+            array<u16, 4> adds;
+            array<u16, 4> subs;
+            const usize   addCount = countDist(engine);
+            const usize   subCount = countDist(engine);
+            for (usize i = 0; i < 4; i++) {
+                adds[i] = featureDist(engine);
+                subs[i] = featureDist(engine);
+            }
+
+            SCALAR.applyRows(stm.data(), expected.data(), weights, adds.data(), addCount, subs.data(), subCount);
+            table->applyRows(stm.data(), actual.data(), weights, adds.data(), addCount, subs.data(), subCount);
+            if (expected != actual)
+                rowMismatches++;
+
+            if constexpr (L2_SIZE > 0) {
+                for (i16& weight : l1Weights)
+                    weight = weightDist(engine);
+
+                alignas(ALIGNMENT) array<i32, L2_SIZE> expectedSums;
+                alignas(ALIGNMENT) array<i32, L2_SIZE> actualSums;
+                SCALAR.sparseL1(stm.data(), nstm.data(), l1Weights.data(), expectedSums.data());
+                table->sparseL1(stm.data(), nstm.data(), l1Weights.data(), actualSums.data());
+                if (expectedSums != actualSums)
+                    l1Mismatches++;
+            }
+        }
+
+        cout << "info string " << table->name << " kernels: " << screluMismatches << "/" << TRIALS << " SCReLU, " << batchMismatches << " batched SCReLU, " << rowMismatches << "/"
+             << TRIALS << " feature row" << (L2_SIZE > 0 ? ", " + std::to_string(l1Mismatches) + "/" + std::to_string(TRIALS) + " sparse L1" : "")
+             << " mismatches against the scalar reference" << endl;
+    }
+}
+}
\ No newline at end of file
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "types.h"
+#include "config.h"
+
+// The NNUE kernels are compiled once per instruction set, and the fastest one this CPU supports is picked at startup.
+// Only raw pointers cross this boundary, so no inline function from the rest of the engine is ever compiled for an
+// instruction set the CPU running it might lack
+namespace Kernels {
+// Positions the batched output layer keeps in registers at once
+constexpr usize BATCH_SIZE = 8;
+
+struct Table {
+    const char* name;
+
+    // Writes input plus the added feature rows minus the removed ones to output, in one pass. Input may equal output
+    void (*applyRows)(const i16* input, i16* output, const FTWeight* weights, const u16* adds, usize addCount, const u16* subs, usize subCount);
+    // Sum of SCReLU(stm) * weights plus SCReLU(nstm) * the second half of weights, before dequantisation
+    i32 (*screlu)(const i16* stm, const i16* nstm, const i16* weights);
+    // screlu for count positions that share one output bucket, loading each weight once for up to BATCH_SIZE of them
+    void (*screluBatch)(const i16* const* stm, const i16* const* nstm, const i16* weights, usize count, i32* out);
+    // First dense layer of a multi layer net on both accumulators clipped to [0, QA], into L2_SIZE integer sums
+    // Pairs of inputs that are both zero after clipping are skipped, which is most of them, out must be aligned like the accumulators
+    void (*sparseL1)(const i16* stm, const i16* nstm, const i16* weights, i32* out);
+};
+
+// Built with the flags of the whole engine, the only table in builds without DISPATCH
+extern const Table BASELINE;
+// Plain C++ without any vector code, only used as a reference
+extern const Table SCALAR;
+#ifdef DISPATCH
+extern const Table AVX2;
+extern const Table AVX_VNNI;
+extern const Table AVX512;
+extern const Table AVX512_VNNI;
+#endif
+
+// The kernels the engine calls, BASELINE until select() runs
+extern Table active;
+
+// Picks the fastest kernels the CPU supports
+void select();
+
+// Runs every table the CPU supports against SCALAR on random inputs and prints the mismatches
+void verify(const FTWeight* weights);
+}
\ No newline at end of file
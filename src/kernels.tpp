@@ -0,0 +1,279 @@
+// Kernel implementations, included once per instruction set by a file that defines KERNEL_TABLE
+
+#include "kernels.h"
+#include "simd.h"
+
+#include <cstring>
+
+namespace {
+#ifdef HAS_SIMD
+constexpr usize VECTOR_SIZE = sizeof(Vectori16) / sizeof(i16);
+// The accumulator is walked in tiles small enough to stay in registers while every feature row is applied
+constexpr usize TILE_REGISTERS = SIMD_REGISTERS < HL_SIZE / VECTOR_SIZE ? SIMD_REGISTERS : HL_SIZE / VECTOR_SIZE;
+constexpr usize TILE_SIZE      = TILE_REGISTERS * VECTOR_SIZE;
+
+static_assert(HL_SIZE % TILE_SIZE == 0, "HL size must be a multiple of the accumulator tile size");
+
+// Loads a vector of feature weights as i16 lanes, widening them when the net stores them as i8
+inline Vectori16 loadWeights(const FTWeight* weights) {
+    if constexpr (sizeof(FTWeight) == 1)
+        return load_epi8_as_epi16(weights);
+    else
+        return load_epi16(weights);
+}
+
+// With the row counts known the inner loops unroll completely, used for the counts a move can produce
+template<usize ADDS, usize SUBS>
+void applyRowsFixed(const i16* input, i16* output, const FTWeight* weights, const u16* adds, const u16* subs) {
+    for (usize tile = 0; tile < HL_SIZE; tile += TILE_SIZE) {
+        Vectori16 registers[TILE_REGISTERS];
+
+    #pragma unroll
+        for (usize i = 0; i < TILE_REGISTERS; i++)
+            registers[i] = load_epi16(input + tile + i * VECTOR_SIZE);
+
+        for (usize add = 0; add < ADDS; add++) {
+            const FTWeight* row = weights + adds[add] * HL_SIZE + tile;
+    #pragma unroll
+            for (usize i = 0; i < TILE_REGISTERS; i++)
+                registers[i] = add_epi16(registers[i], loadWeights(row + i * VECTOR_SIZE));
+        }
+
+        for (usize sub = 0; sub < SUBS; sub++) {
+            const FTWeight* row = weights + subs[sub] * HL_SIZE + tile;
+    #pragma unroll
+            for (usize i = 0; i < TILE_REGISTERS; i++)
+                registers[i] = sub_epi16(registers[i], loadWeights(row + i * VECTOR_SIZE));
+        }
+
+    #pragma unroll
+        for (usize i = 0; i < TILE_REGISTERS; i++)
+            store_epi16(output + tile + i * VECTOR_SIZE, registers[i]);
+    }
+}
+
+void applyRowsAny(const i16* input, i16* output, const FTWeight* weights, const u16* adds, usize addCount, const u16* subs, usize subCount) {
+    for (usize tile = 0; tile < HL_SIZE; tile += TILE_SIZE) {
+        Vectori16 registers[TILE_REGISTERS];
+
+    #pragma unroll
+        for (usize i = 0; i < TILE_REGISTERS; i++)
+            registers[i] = load_epi16(input + tile + i * VECTOR_SIZE);
+
+        for (usize add = 0; add < addCount; add++) {
+            const FTWeight* row = weights + adds[add] * HL_SIZE + tile;
+    #pragma unroll
+            for (usize i = 0; i < TILE_REGISTERS; i++)
+                registers[i] = add_epi16(registers[i], loadWeights(row + i * VECTOR_SIZE));
+        }
+
+        for (usize sub = 0; sub < subCount; sub++) {
+            const FTWeight* row = weights + subs[sub] * HL_SIZE + tile;
+    #pragma unroll
+            for (usize i = 0; i < TILE_REGISTERS; i++)
+                registers[i] = sub_epi16(registers[i], loadWeights(row + i * VECTOR_SIZE));
+        }
+
+    #pragma unroll
+        for (usize i = 0; i < TILE_REGISTERS; i++)
+            store_epi16(output + tile + i * VECTOR_SIZE, registers[i]);
+    }
+}
+
+void applyRows(const i16* input, i16* output, const FTWeight* weights, const u16* adds, usize addCount, const u16* subs, usize subCount) {
+    if (addCount == 1 && subCount == 1)
+        applyRowsFixed<1, 1>(input, output, weights, adds, subs);
+    else if (addCount == 1 && subCount == 2)
+        applyRowsFixed<1, 2>(input, output, weights, adds, subs);
+    else if (addCount == 2 && subCount == 2)
+        applyRowsFixed<2, 2>(input, output, weights, adds, subs);
+    else
+        applyRowsAny(input, output, weights, adds, addCount, subs, subCount);
+}
+
+i32 screlu(const i16* stm, const i16* nstm, const i16* weights) {
+    const Vectori16 VEC_QA   = set1_epi16(QA);
+    const Vectori16 VEC_ZERO = set1_epi16(0);
+
+    Vectori32 accumulator{};
+
+    #pragma unroll
+    for (usize i = 0; i < HL_SIZE; i += VECTOR_SIZE) {
+        // Load accumulators
+        const Vectori16 stmAccumValues  = load_epi16(stm + i);
+        const Vectori16 nstmAccumValues = load_epi16(nstm + i);
+
+        // Clamp values
+        const Vectori16 stmClamped  = min_epi16(VEC_QA, max_epi16(stmAccumValues, VEC_ZERO));
+        const Vectori16 nstmClamped = min_epi16(VEC_QA, max_epi16(nstmAccumValues, VEC_ZERO));
+
+        // Load weights
+        const Vectori16 stmWeights  = load_epi16(weights + i);
+        const Vectori16 nstmWeights = load_epi16(weights + i + HL_SIZE);
+
+        // SCReLU it, clamped * (clamped * weight) can't overflow i16 as long as |weight| <= QB * 2
+        accumulator = dpwssd_epi32(accumulator, stmClamped, mullo_epi16(stmClamped, stmWeights));
+        accumulator = dpwssd_epi32(accumulator, nstmClamped, mullo_epi16(nstmClamped, nstmWeights));
+    }
+
+    return reduce_epi32(accumulator);
+}
+
+template<usize COUNT>
+void screluFixed(const i16* const* stm, const i16* const* nstm, const i16* weights, i32* out) {
+    const Vectori16 VEC_QA   = set1_epi16(QA);
+    const Vectori16 VEC_ZERO = set1_epi16(0);
+
+    Vectori32 accumulators[COUNT]{};
+
+    for (usize i = 0; i < HL_SIZE; i += VECTOR_SIZE) {
+        const Vectori16 stmWeights  = load_epi16(weights + i);
+        const Vectori16 nstmWeights = load_epi16(weights + i + HL_SIZE);
+
+    #pragma unroll
+        for (usize b = 0; b < COUNT; b++) {
+            const Vectori16 stmClamped  = min_epi16(VEC_QA, max_epi16(load_epi16(stm[b] + i), VEC_ZERO));
+            const Vectori16 nstmClamped = min_epi16(VEC_QA, max_epi16(load_epi16(nstm[b] + i), VEC_ZERO));
+
+            accumulators[b] = dpwssd_epi32(accumulators[b], stmClamped, mullo_epi16(stmClamped, stmWeights));
+            accumulators[b] = dpwssd_epi32(accumulators[b], nstmClamped, mullo_epi16(nstmClamped, nstmWeights));
+        }
+    }
+
+    #pragma unroll
+    for (usize b = 0; b < COUNT; b++)
+        out[b] = reduce_epi32(accumulators[b]);
+}
+
+void screluBatch(const i16* const* stm, const i16* const* nstm, const i16* weights, usize count, i32* out) {
+    static_assert(Kernels::BATCH_SIZE == 8, "Batch is split into fixed sizes of 8, 4, 2 and 1");
+
+    usize done = 0;
+    while (done < count) {
+        const usize remaining = count - done;
+        if (remaining >= 8) {
+            screluFixed<8>(stm + done, nstm + done, weights, out + done);
+            done += 8;
+        }
+        else if (remaining >= 4) {
+            screluFixed<4>(stm + done, nstm + done, weights, out + done);
+            done += 4;
+        }
+        else if (remaining >= 2) {
+            screluFixed<2>(stm + done, nstm + done, weights, out + done);
+            done += 2;
+        }
+        else {
+            out[done] = screlu(stm[done], nstm[done], weights);
+            done++;
+        }
+    }
+}
+
+// Each pair of inputs holds L2_SIZE outputs * 2 weights, which has to fill whole vectors
+static_assert(L2_SIZE * 2 % VECTOR_SIZE == 0, "L2 size must fill whole vectors of i32");
+constexpr usize L1_REGISTERS = L2_SIZE == 0 ? 1 : L2_SIZE * 2 / VECTOR_SIZE;
+
+void sparseL1(const i16* stm, const i16* nstm, const i16* weights, i32* out) {
+    const Vectori16 VEC_QA   = set1_epi16(QA);
+    const Vectori16 VEC_ZERO = set1_epi16(0);
+
+    alignas(sizeof(Vectori16)) array<i16, HL_SIZE * 2> inputs;
+    array<u16, HL_SIZE>                                 nonZero;
+    usize                                               nonZeroCount = 0;
+
+    // Clip both accumulators, noting every pair of inputs with a non-zero value on the way
+    for (usize half = 0; half < 2; half++) {
+        const i16* accumulator = half == 0 ? stm : nstm;
+        for (usize i = 0; i < HL_SIZE; i += VECTOR_SIZE) {
+            const usize     offset  = half * HL_SIZE + i;
+            const Vectori16 clipped = min_epi16(VEC_QA, max_epi16(load_epi16(accumulator + i), VEC_ZERO));
+            store_epi16(inputs.data() + offset, clipped);
+
+            u64 mask = nonzero_pairs_mask(clipped);
+            while (mask) {
+                nonZero[nonZeroCount++] = offset / 2 + std::countr_zero(mask);
+                mask &= mask - 1;
+            }
+        }
+    }
+
+    // Even and odd entries of the list go to separate sums, so consecutive multiply-adds don't wait on each other
+    Vectori32 sums[2][L1_REGISTERS]{};
+
+    auto accumulatePair = [&](Vectori32* pairSums, usize pair) {
+        i32 packed;
+        std::memcpy(&packed, inputs.data() + pair * 2, sizeof(packed));
+        const Vectori16 broadcast = set1_pair_epi16(packed);
+        const i16*      row       = weights + pair * L2_SIZE * 2;
+
+    #pragma unroll
+        for (usize r = 0; r < L1_REGISTERS; r++)
+            pairSums[r] = dpwssd_epi32(pairSums[r], broadcast, load_epi16(row + r * VECTOR_SIZE));
+    };
+
+    usize k = 0;
+    for (; k + 1 < nonZeroCount; k += 2) {
+        accumulatePair(sums[0], nonZero[k]);
+        accumulatePair(sums[1], nonZero[k + 1]);
+    }
+    if (k < nonZeroCount)
+        accumulatePair(sums[0], nonZero[k]);
+
+    #pragma unroll
+    for (usize r = 0; r < L2_SIZE * 2 / VECTOR_SIZE; r++)
+        store_epi32(out + r * VECTOR_SIZE / 2, add_epi32(sums[0][r], sums[1][r]));
+}
+#else
+void applyRows(const i16* input, i16* output, const FTWeight* weights, const u16* adds, usize addCount, const u16* subs, usize subCount) {
+    for (usize i = 0; i < HL_SIZE; i++) {
+        i16 value = input[i];
+        for (usize add = 0; add < addCount; add++)
+            value += weights[adds[add] * HL_SIZE + i];
+        for (usize sub = 0; sub < subCount; sub++)
+            value -= weights[subs[sub] * HL_SIZE + i];
+        output[i] = value;
+    }
+}
+
+i32 screlu(const i16* stm, const i16* nstm, const i16* weights) {
+    auto activate = [](i16 x) -> i32 {
+        const i32 clamped = x < 0 ? 0 : x > QA ? QA : x;
+        return clamped * clamped;
+    };
+
+    i32 res = 0;
+
+    #pragma unroll
+    for (usize i = 0; i < HL_SIZE; i++) {
+        res += activate(stm[i]) * weights[i];
+        res += activate(nstm[i]) * weights[i + HL_SIZE];
+    }
+    return res;
+}
+
+void screluBatch(const i16* const* stm, const i16* const* nstm, const i16* weights, usize count, i32* out) {
+    for (usize b = 0; b < count; b++)
+        out[b] = screlu(stm[b], nstm[b], weights);
+}
+
+void sparseL1(const i16* stm, const i16* nstm, const i16* weights, i32* out) {
+    for (usize output = 0; output < L2_SIZE; output++)
+        out[output] = 0;
+
+    for (usize input = 0; input < HL_SIZE * 2; input++) {
+        const i16 value   = input < HL_SIZE ? stm[input] : nstm[input - HL_SIZE];
+        const i32 clipped = value < 0 ? 0 : value > QA ? QA : value;
+        if (clipped == 0)
+            continue;
+
+        // Weights of a pair of inputs are interleaved for every output
+        const i16* row = weights + (input / 2) * L2_SIZE * 2 + input % 2;
+        for (usize output = 0; output < L2_SIZE; output++)
+            out[output] += clipped * row[output * 2];
+    }
+}
+#endif
+}
+
+extern const Kernels::Table KERNEL_TABLE = {SIMD_NAME, applyRows, screlu, screluBatch, sparseL1};
\ No newline at end of file
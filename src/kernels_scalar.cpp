@@ -0,0 +1,4 @@
+// Plain C++ kernels, the reference the SIMD kernels are checked against with debug.kernels
+#define NO_SIMD
+#define KERNEL_TABLE Kernels::SCALAR
+#include "kernels.tpp"
\ No newline at end of file
@@ -0,0 +1,219 @@
+#include "memory.h"
+
+#include <cctype>
+#include <chrono>
+#include <thread>
+#include <fstream>
+#include <sstream>
+
+#ifdef __linux__
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+
+    // glibc only has the shift, the page size flags are in <linux/mman.h> which redefines it
+    #if defined(MAP_HUGE_SHIFT) && !defined(MAP_HUGE_2MB)
+        #define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+        #define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+    #endif
+#endif
+
+namespace Memory {
+constexpr usize CACHE_LINE = 64;
+constexpr usize SIZE_2MB   = 2ULL * 1024 * 1024;
+constexpr usize SIZE_1GB   = 1024ULL * 1024 * 1024;
+
+static usize roundUp(usize bytes, usize multiple) { return (bytes + multiple - 1) / multiple * multiple; }
+
+Allocation allocateLarge(usize bytes) {
+    Allocation allocation;
+
+#ifdef __linux__
+    auto tryHugeTLB = [&](usize pageBytes, int flags, PageSize pages) {
+        const usize rounded = roundUp(bytes, pageBytes);
+        void*       ptr     = mmap(nullptr, rounded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | flags, -1, 0);
+        if (ptr == MAP_FAILED)
+            return false;
+        allocation = Allocation{ptr, rounded, pages, true};
+        return true;
+    };
+
+    #ifdef MAP_HUGE_1GB
+    // Only worth it when the table covers a whole page, and only succeeds if the admin reserved 1GB pages
+    if (bytes >= SIZE_1GB && tryHugeTLB(SIZE_1GB, MAP_HUGE_1GB, PageSize::HUGE_1GB))
+        return allocation;
+    #endif
+    #ifdef MAP_HUGE_2MB
+    if (bytes >= SIZE_2MB && tryHugeTLB(SIZE_2MB, MAP_HUGE_2MB, PageSize::HUGE_2MB))
+        return allocation;
+    #endif
+
+    // No reserved pages, fall back to normal pages and ask for transparent huge pages
+    const usize mapBytes = roundUp(bytes, SIZE_2MB);
+    void*       ptr      = mmap(nullptr, mapBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr != MAP_FAILED) {
+        allocation = Allocation{ptr, mapBytes, PageSize::SMALL, true};
+    #ifdef MADV_HUGEPAGE
+        if (madvise(ptr, mapBytes, MADV_HUGEPAGE) == 0)
+            allocation.pages = PageSize::TRANSPARENT_2MB;
+    #endif
+        return allocation;
+    }
+#endif
+
+    const usize rounded = roundUp(bytes, CACHE_LINE);
+#ifdef _MSC_VER
+    allocation = Allocation{_aligned_malloc(rounded, CACHE_LINE), rounded, PageSize::SMALL, false};
+#else
+    allocation = Allocation{std::aligned_alloc(CACHE_LINE, rounded), rounded, PageSize::SMALL, false};
+#endif
+    return allocation;
+}
+
+void free(Allocation& allocation) {
+    if (allocation.ptr == nullptr)
+        return;
+#ifdef __linux__
+    if (allocation.mapped)
+        munmap(allocation.ptr, allocation.bytes);
+    else
+        std::free(allocation.ptr);
+#elif defined(_MSC_VER)
+    _aligned_free(allocation.ptr);
+#else
+    std::free(allocation.ptr);
+#endif
+    allocation = Allocation{};
+}
+
+Allocation openShared(const string& name, usize bytes, bool& created) {
+    assert(!name.empty());
+    created = false;
+
+#ifdef __linux__
+    // POSIX wants the name to start with a slash and contain no others
+    const string shmName = name.front() == '/' ? name : "/" + name;
+
+    int fd = shm_open(shmName.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd >= 0) {
+        created = true;
+        if (ftruncate(fd, bytes) != 0) {
+            close(fd);
+            shm_unlink(shmName.c_str());
+            return Allocation{};
+        }
+    }
+    else {
+        fd = shm_open(shmName.c_str(), O_RDWR, 0600);
+        if (fd < 0)
+            return Allocation{};
+
+        // The creator may still be between shm_open and ftruncate
+        struct stat st;
+        for (usize attempt = 0; attempt < 100 && fstat(fd, &st) == 0 && st.st_size == 0; attempt++)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        if (fstat(fd, &st) != 0 || st.st_size == 0) {
+            close(fd);
+            return Allocation{};
+        }
+        bytes = st.st_size;
+    }
+
+    void* ptr = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED)
+        return Allocation{};
+
+    Allocation allocation{ptr, bytes, PageSize::SMALL, true};
+    #ifdef MADV_HUGEPAGE
+    // Only honoured for shared memory when the admin set shmem_enabled, harmless otherwise
+    madvise(ptr, bytes, MADV_HUGEPAGE);
+    #endif
+    return allocation;
+#else
+    (void) name;
+    (void) bytes;
+    return Allocation{};
+#endif
+}
+
+MappedFile::MappedFile(const string& path) {
+    view   = nullptr;
+    length = 0;
+
+#ifdef __linux__
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return;
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        void* ptr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (ptr != MAP_FAILED) {
+            view   = static_cast<const u8*>(ptr);
+            length = st.st_size;
+        }
+    }
+    close(fd);
+#else
+    std::ifstream stream(path, std::ios::binary | std::ios::ate);
+    if (!stream.is_open())
+        return;
+
+    buffer.resize(stream.tellg());
+    stream.seekg(0);
+    if (buffer.empty() || !stream.read(reinterpret_cast<char*>(buffer.data()), buffer.size()))
+        return;
+    view   = buffer.data();
+    length = buffer.size();
+#endif
+}
+
+MappedFile::~MappedFile() {
+#ifdef __linux__
+    if (view != nullptr)
+        munmap(const_cast<u8*>(view), length);
+#endif
+}
+
+// Returns how many bytes of the mapping are backed by transparent huge pages, according to /proc/self/smaps
+static usize transparentHugeBytes(const Allocation& allocation) {
+    std::ifstream smaps("/proc/self/smaps");
+    const u64     start = reinterpret_cast<u64>(allocation.ptr);
+    string        line;
+    bool          inMapping = false;
+
+    while (std::getline(smaps, line)) {
+        const usize dash = line.find('-');
+        if (dash != string::npos && line.find(' ') > dash && std::isxdigit(line[0])) {
+            inMapping = std::stoull(line.substr(0, dash), nullptr, 16) == start;
+            continue;
+        }
+        if (inMapping && line.rfind("AnonHugePages:", 0) == 0) {
+            std::istringstream ss(line.substr(14));
+            usize              kb = 0;
+            ss >> kb;
+            return kb * 1024;
+        }
+    }
+    return 0;
+}
+
+string describePages(const Allocation& allocation) {
+    switch (allocation.pages) {
+    case PageSize::HUGE_1GB:
+        return "1GB huge pages";
+    case PageSize::HUGE_2MB:
+        return "2MB huge pages";
+    case PageSize::TRANSPARENT_2MB: {
+        const usize huge = transparentHugeBytes(allocation);
+        if (huge == 0)
+            return "4KB pages (transparent huge pages unavailable)";
+        return "2MB transparent huge pages (" + std::to_string(huge * 100 / allocation.bytes) + "% of table)";
+    }
+    default:
+        return "4KB pages";
+    }
+}
+}
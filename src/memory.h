@@ -0,0 +1,49 @@
+#pragma once
+
+#include "types.h"
+
+namespace Memory {
+enum class PageSize {
+    SMALL,
+    TRANSPARENT_2MB,
+    HUGE_2MB,
+    HUGE_1GB
+};
+
+struct Allocation {
+    void*    ptr    = nullptr;
+    usize    bytes  = 0;
+    PageSize pages  = PageSize::SMALL;
+    bool     mapped = false;
+};
+
+// Allocates at least the given number of bytes aligned to a cache line, backed by the largest pages the OS will give
+// The memory is not touched, so pages are placed on the NUMA node of whichever thread writes them first
+Allocation allocateLarge(usize bytes);
+void       free(Allocation& allocation);
+
+// Maps the named POSIX shared memory segment, creating it zero filled with the given size if it doesn't exist yet
+// Returns an empty allocation on failure or where shared memory isn't supported. bytes is the size of the whole segment
+Allocation openShared(const string& name, usize bytes, bool& created);
+
+// Read-only view of a whole file. Memory mapped where supported, otherwise read into a buffer
+class MappedFile {
+    const u8*       view;
+    usize           length;
+    std::vector<u8> buffer;
+
+   public:
+    explicit MappedFile(const string& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile& other)            = delete;
+    MappedFile& operator=(const MappedFile& other) = delete;
+
+    bool      isOpen() const { return view != nullptr; }
+    const u8* data() const { return view; }
+    usize     size() const { return length; }
+};
+
+// Describes the pages backing an allocation. Transparent huge pages are checked against the kernel after first touch
+string describePages(const Allocation& allocation);
+}
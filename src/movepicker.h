@@ -37,7 +37,8 @@ struct Movepicker {
         moves = Movegen::generateMoves<mode>(board);
         seen  = 0;
 
-        TTMove = thisThread.TT.getEntry(board.zobrist)->move;
+        const Transposition ttEntry = thisThread.TT.getEntry(board.zobrist);
+        TTMove                      = ttEntry.zobrist == board.zobrist ? ttEntry.move : Move::null();
 
         for (usize i = 0; i < moves.length; i++) {
             const Move m = moves.moves[i];
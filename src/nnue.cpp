@@ -5,12 +5,161 @@
 #include "thread.h"
 #include "accumulator.h"
 #include "search.h"
+#include "kernels.h"
+#include "memory.h"
 
 #include "../external/fmt/fmt/format.h"
 
 #include <fstream>
 #include <cstring>
+#include <cstddef>
 #include <algorithm>
+#include <numeric>
+#include <type_traits>
+#include <thread>
+
+namespace {
+constexpr array<char, 8> NETWORK_FILE_MAGIC   = {'P', 'R', 'L', 'D', 'N', 'N', 'U', 'E'};
+constexpr u32            NETWORK_FILE_VERSION = 3;
+
+// Written in front of the weights by savenet. Nets straight from the trainer have none
+// A whole cache line, so the weights of a mapped file stay aligned for the kernels
+struct alignas(64) NetworkFileHeader {
+    array<char, 8> magic;
+    u32            version;
+    u32            activation;
+    u32            inputs;
+    u32            hlSize;
+    u32            outputBuckets;
+    u32            l2Size;
+    u32            l3Size;
+    i16            qa;
+    i16            qb;
+    i16            ql1;
+    u64            hash;
+};
+
+// Size of the weights in a file, which stores the quantised layers as little endian i16 and the rest as f32
+constexpr usize NETWORK_BYTES = (HL_SIZE * 768 + HL_SIZE + OUTPUT_BUCKETS * OUTPUT_LAYER_INPUTS + OUTPUT_LAYER_BIASES + OUTPUT_BUCKETS * HL_SIZE * 2 * L2_SIZE) * sizeof(i16)
+                              + (OUTPUT_BUCKETS * (L2_SIZE + L2_SIZE * DENSE_L3_SIZE + DENSE_L3_SIZE * 2) + DENSE_L3_BIASES) * sizeof(float);
+
+static_assert(sizeof(NetworkFileHeader) == 64, "Network file header must keep the weights cache line aligned");
+
+// Borrowing casts the weights of a file straight to NetworkWeights, so the layers must sit where the file has them
+constexpr bool BORROWABLE_LAYOUT = L2_SIZE == 0 && std::is_same_v<FTWeight, i16>;
+static_assert(!BORROWABLE_LAYOUT || offsetof(NetworkWeights, weightsToHL) == 0, "Feature weights must start the file");
+static_assert(!BORROWABLE_LAYOUT || offsetof(NetworkWeights, hiddenLayerBias) == HL_SIZE * 768 * sizeof(i16), "Hidden layer bias must follow the feature weights");
+static_assert(!BORROWABLE_LAYOUT || offsetof(NetworkWeights, weightsToOut) == (HL_SIZE * 768 + HL_SIZE) * sizeof(i16), "Output weights must follow the hidden layer bias");
+static_assert(!BORROWABLE_LAYOUT || offsetof(NetworkWeights, outputBias) == (HL_SIZE * 768 + HL_SIZE + OUTPUT_BUCKETS * OUTPUT_LAYER_INPUTS) * sizeof(i16),
+              "Output bias must follow the output weights");
+static_assert(!BORROWABLE_LAYOUT || offsetof(NetworkWeights, outputBias) + OUTPUT_LAYER_BIASES * sizeof(i16) == NETWORK_BYTES, "Output bias must end the file");
+
+u64 fnv1a(const u8* data, usize bytes) {
+    u64 hash = 0xCBF29CE484222325;
+    for (usize i = 0; i < bytes; i++)
+        hash = (hash ^ data[i]) * 0x100000001B3;
+    return hash;
+}
+
+// Copies count weights out of the file and advances past them, narrowing them when T is smaller than i16
+// Returns how many had to be clamped to fit
+template<typename T>
+usize decodeWeights(const u8*& data, T* out, usize count) {
+    usize clamped = 0;
+
+    if (std::is_same_v<T, i16> && IS_LITTLE_ENDIAN)
+        std::memcpy(out, data, count * sizeof(i16));
+    else {
+        for (usize i = 0; i < count; i++) {
+            const i16 weight = static_cast<i16>(data[i * 2] | data[i * 2 + 1] << 8);
+            out[i]           = static_cast<T>(std::clamp<i16>(weight, std::numeric_limits<T>::min(), std::numeric_limits<T>::max()));
+            clamped += out[i] != weight;
+        }
+    }
+
+    data += count * sizeof(i16);
+    return clamped;
+}
+
+void decodeFloats(const u8*& data, float* out, usize count) {
+    if (IS_LITTLE_ENDIAN)
+        std::memcpy(out, data, count * sizeof(float));
+    else {
+        for (usize i = 0; i < count; i++) {
+            const u32 bits = data[i * 4] | data[i * 4 + 1] << 8 | data[i * 4 + 2] << 16 | static_cast<u32>(data[i * 4 + 3]) << 24;
+            std::memcpy(&out[i], &bits, sizeof(float));
+        }
+    }
+
+    data += count * sizeof(float);
+}
+
+// Position of first dense layer weight (input, output) once the weights of each pair of inputs are interleaved
+usize l1Index(usize input, usize output) { return ((input / 2) * L2_SIZE + output) * 2 + input % 2; }
+
+// Hidden neurons from most to least often active over the bench positions. The sparse first dense layer skips pairs of
+// neurons that are both clipped to zero, which happens far more often once neurons that are zero together sit side by side
+array<u16, HL_SIZE> sparsityOrder(const NetworkWeights& net) {
+    array<usize, HL_SIZE> activity{};
+
+    for (const string& fen : Search::BENCH_FENS) {
+        Board board;
+        board.loadFromFEN(fen);
+
+        for (Color perspective : {WHITE, BLACK}) {
+            array<i32, HL_SIZE> values;
+            for (usize i = 0; i < HL_SIZE; i++)
+                values[i] = net.hiddenLayerBias[i];
+
+            for (Color color : {WHITE, BLACK}) {
+                u64 pieces = board.pieces(color);
+                while (pieces) {
+                    const Square    sq  = popLSB(pieces);
+                    const FTWeight* row = net.weightsToHL.data() + NNUE::feature(perspective, color, board.getPiece(sq), sq) * HL_SIZE;
+                    for (usize i = 0; i < HL_SIZE; i++)
+                        values[i] += row[i];
+                }
+            }
+
+            for (usize i = 0; i < HL_SIZE; i++)
+                activity[i] += values[i] > 0;
+        }
+    }
+
+    array<u16, HL_SIZE> order;
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](u16 a, u16 b) { return activity[a] > activity[b]; });
+    return order;
+}
+
+template<typename T>
+void permuteRow(T* values, const array<u16, HL_SIZE>& order) {
+    array<T, HL_SIZE> original;
+    std::copy_n(values, HL_SIZE, original.begin());
+    for (usize i = 0; i < HL_SIZE; i++)
+        values[i] = original[order[i]];
+}
+
+// Moves hidden neuron order[i] to position i in every layer that reads or writes the hidden layer
+// The kernels treat each neuron the same, so the net computes the same evals in any order
+void permuteHidden(NetworkWeights& net, const array<u16, HL_SIZE>& order) {
+    for (usize feature = 0; feature < 768; feature++)
+        permuteRow(net.weightsToHL.data() + feature * HL_SIZE, order);
+    permuteRow(net.hiddenLayerBias.data(), order);
+
+    for (auto& bucket : net.weightsToOut)
+        for (usize half = 0; half < OUTPUT_LAYER_INPUTS; half += HL_SIZE)
+            permuteRow(bucket.data() + half, order);
+
+    for (auto& bucket : net.l1Weights) {
+        const std::vector<i16> original(bucket.begin(), bucket.end());
+        for (usize half = 0; half < HL_SIZE * 2; half += HL_SIZE)
+            for (usize i = 0; i < HL_SIZE; i++)
+                for (usize output = 0; output < L2_SIZE; output++)
+                    bucket[l1Index(half + i, output)] = original[l1Index(half + order[i], output)];
+    }
+}
+}
 
 i16 NNUE::ReLU(const i16 x) {
     if (x < 0)
@@ -34,128 +183,7 @@ i32 NNUE::SCReLU(const i16 x) {
     return x * x;
 }
 
-#if defined(__x86_64__) || defined(__amd64__) || (defined(_WIN64) && (defined(_M_X64) || defined(_M_AMD64)) || defined(__ARM_NEON))
-    #ifndef __ARM_NEON
-        #include <immintrin.h>
-    #endif
-    #if defined(__AVX512F__)
-        #pragma message("Using AVX512 NNUE inference")
-using Vectori16 = __m512i;
-using Vectori32 = __m512i;
-        #define set1_epi16 _mm512_set1_epi16
-        #define load_epi16(x) _mm512_load_si512(reinterpret_cast<const Vectori16*>(x))
-        #define min_epi16 _mm512_min_epi16
-        #define max_epi16 _mm512_max_epi16
-        #define madd_epi16 _mm512_madd_epi16
-        #define mullo_epi16 _mm512_mullo_epi16
-        #define add_epi32 _mm512_add_epi32
-        #define reduce_epi32 _mm512_reduce_add_epi32
-    #elif defined(__AVX2__)
-        #pragma message("Using AVX2 NNUE inference")
-using Vectori16 = __m256i;
-using Vectori32 = __m256i;
-        #define set1_epi16 _mm256_set1_epi16
-        #define load_epi16(x) _mm256_load_si256(reinterpret_cast<const Vectori16*>(x))
-        #define min_epi16 _mm256_min_epi16
-        #define max_epi16 _mm256_max_epi16
-        #define madd_epi16 _mm256_madd_epi16
-        #define mullo_epi16 _mm256_mullo_epi16
-        #define add_epi32 _mm256_add_epi32
-        #define reduce_epi32 \
-            [](Vectori32 vec) { \
-                __m128i xmm1 = _mm256_extracti128_si256(vec, 1); \
-                __m128i xmm0 = _mm256_castsi256_si128(vec); \
-                xmm0         = _mm_add_epi32(xmm0, xmm1); \
-                xmm1         = _mm_shuffle_epi32(xmm0, 238); \
-                xmm0         = _mm_add_epi32(xmm0, xmm1); \
-                xmm1         = _mm_shuffle_epi32(xmm0, 85); \
-                xmm0         = _mm_add_epi32(xmm0, xmm1); \
-                return _mm_cvtsi128_si32(xmm0); \
-            }
-    #elif defined(__ARM_NEON)
-        #include <arm_neon.h>
-        #pragma message("Using NEON NNUE inference")
-using Vectori16 = int16x8_t;
-using Vectori32 = int32x4_t;
-        #define set1_epi16 vdupq_n_s16
-        #define load_epi16(x) vld1q_s16(reinterpret_cast<const i16*>(x))
-        #define min_epi16 vminq_s16
-        #define max_epi16 vmaxq_s16
-        #define madd_epi16 \
-            [](Vectori16 a, Vectori16 b) { \
-                const Vectori16 low = vmull_s16(vget_low_s16(a), vget_low_s16(b)); \
-                const Vectori16 high = vmull_high_s16(a, b); \
-                return vpaddq_s32(low, high); \
-            }
-        #define mullo_epi16 vmulq_s16
-        #define add_epi32 vaddq_s32
-        #define reduce_epi32 vaddvq_s32
-    #else
-        #pragma message("Using SSE NNUE inference")
-// Assumes SSE support here
-using Vectori16 = __m128i;
-using Vectori32 = __m128i;
-        #define set1_epi16 _mm_set1_epi16
-        #define load_epi16(x) _mm_load_si128(reinterpret_cast<const Vectori16*>(x))
-        #define min_epi16 _mm_min_epi16
-        #define max_epi16 _mm_max_epi16
-        #define madd_epi16 _mm_madd_epi16
-        #define mullo_epi16 _mm_mullo_epi16
-        #define add_epi32 _mm_add_epi32
-        #define reduce_epi32 \
-            [](Vectori32 vec) { \
-                __m128i xmm1 = _mm_shuffle_epi32(vec, 238); \
-                vec          = _mm_add_epi32(vec, xmm1); \
-                xmm1         = _mm_shuffle_epi32(vec, 85); \
-                vec          = _mm_add_epi32(vec, xmm1); \
-                return _mm_cvtsi128_si32(vec); \
-            }
-    #endif
-i32 NNUE::vectorizedSCReLU(const Accumulator& stm, const Accumulator& nstm, usize bucket) {
-    const usize VECTOR_SIZE = sizeof(Vectori16) / sizeof(i16);
-    static_assert(HL_SIZE % VECTOR_SIZE == 0, "HL size must be divisible by the native register size of your CPU for vectorization to work");
-    const Vectori16 VEC_QA   = set1_epi16(QA);
-    const Vectori16 VEC_ZERO = set1_epi16(0);
-
-    Vectori32 accumulator{};
-
-    #pragma unroll
-    for (usize i = 0; i < HL_SIZE; i += VECTOR_SIZE) {
-        // Load accumulators
-        const Vectori16 stmAccumValues  = load_epi16(&stm[i]);
-        const Vectori16 nstmAccumValues = load_epi16(&nstm[i]);
-
-        // Clamp values
-        const Vectori16 stmClamped  = min_epi16(VEC_QA, max_epi16(stmAccumValues, VEC_ZERO));
-        const Vectori16 nstmClamped = min_epi16(VEC_QA, max_epi16(nstmAccumValues, VEC_ZERO));
-
-        // Load weights
-        const Vectori16 stmWeights  = load_epi16(reinterpret_cast<const Vectori16*>(&weightsToOut[bucket][i]));
-        const Vectori16 nstmWeights = load_epi16(reinterpret_cast<const Vectori16*>(&weightsToOut[bucket][i + HL_SIZE]));
-
-        // SCReLU it
-        const Vectori32 stmActivated  = madd_epi16(stmClamped, mullo_epi16(stmClamped, stmWeights));
-        const Vectori32 nstmActivated = madd_epi16(nstmClamped, mullo_epi16(nstmClamped, nstmWeights));
-
-        accumulator = add_epi32(accumulator, stmActivated);
-        accumulator = add_epi32(accumulator, nstmActivated);
-    }
-
-    return reduce_epi32(accumulator);
-}
-#else
-    #pragma message("Using compiler optimized NNUE inference")
-i32 NNUE::vectorizedSCReLU(const Accumulator& stm, const Accumulator& nstm, usize bucket) {
-    i32 res = 0;
-
-    #pragma unroll
-    for (usize i = 0; i < HL_SIZE; i++) {
-        res += (i32) SCReLU(stm[i]) * weightsToOut[bucket][i];
-        res += (i32) SCReLU(nstm[i]) * weightsToOut[bucket][i + HL_SIZE];
-    }
-    return res;
-}
-#endif
+i32 NNUE::vectorizedSCReLU(const Accumulator& stm, const Accumulator& nstm, usize bucket) { return Kernels::active.screlu(stm.data(), nstm.data(), weights->weightsToOut[bucket].data()); }
 
 // Finds the input feature
 usize NNUE::feature(Color perspective, Color color, PieceType piece, Square square) {
@@ -165,43 +193,224 @@ usize NNUE::feature(Color perspective, Color color, PieceType piece, Square squa
     return colorIndex * 64 * 6 + piece * 64 + squareIndex;
 }
 
-void NNUE::loadNetwork(const string& filepath) {
-    std::ifstream stream(filepath, std::ios::binary);
-    if (!stream.is_open()) {
-        cerr << "Failed to open file: " + filepath << endl;
-        cerr << "Expect engine to not work as intended with bad evaluation" << endl;
+bool NNUE::loadNetwork(const string& filepath, bool share) {
+    auto file = std::make_unique<Memory::MappedFile>(filepath);
+    if (!file->isOpen()) {
+        cout << "info string Could not open " << filepath << " to load the network" << endl;
+        return false;
     }
 
-    // Load weightsToHL
-    for (usize i = 0; i < weightsToHL.size(); ++i) {
-        weightsToHL[i] = readLittleEndian<i16>(stream);
-    }
+    if (!loadNetwork(file->data(), file->size(), filepath, share))
+        return false;
+
+    // Keep the mapping alive for as long as the weights point into it
+    mapped = weights == owned.get() ? nullptr : std::move(file);
+    return true;
+}
 
-    // Load hiddenLayerBias
-    for (usize i = 0; i < hiddenLayerBias.size(); ++i) {
-        hiddenLayerBias[i] = readLittleEndian<i16>(stream);
+bool NNUE::loadNetwork(const u8* data, usize bytes, const string& name, bool borrow) {
+    auto reject = [&](const string& reason) {
+        cout << "info string Rejected network " << name << ": " << reason << endl;
+        return false;
+    };
+
+    // Everything is checked before the first weight is written, so a bad file leaves the current net in place
+    const u8* payload = data;
+    if (bytes >= sizeof(NetworkFileHeader) && std::memcmp(data, NETWORK_FILE_MAGIC.data(), NETWORK_FILE_MAGIC.size()) == 0) {
+        NetworkFileHeader header;
+        std::memcpy(&header, data, sizeof(header));
+
+        if (header.version != NETWORK_FILE_VERSION)
+            return reject("unsupported network file version " + std::to_string(header.version));
+        if (header.activation != ACTIVATION || header.inputs != 768 || header.hlSize != HL_SIZE || header.outputBuckets != OUTPUT_BUCKETS || header.l2Size != L2_SIZE
+            || header.l3Size != DENSE_L3_SIZE)
+            return reject(fmt::format("architecture (768->{})x2->{}->{}->1x{} differs from this build", header.hlSize, header.l2Size, header.l3Size, header.outputBuckets));
+        if (header.qa != QA || header.qb != QB || header.ql1 != QL1)
+            return reject(fmt::format("quantisation QA={} QB={} QL1={} differs from this build", header.qa, header.qb, header.ql1));
+        if (bytes != sizeof(NetworkFileHeader) + NETWORK_BYTES)
+            return reject("file is truncated or has trailing data");
+
+        payload += sizeof(NetworkFileHeader);
+        if (fnv1a(payload, NETWORK_BYTES) != header.hash)
+            return reject("checksum mismatch, the file is corrupt");
+    }
+    // Raw nets straight from the trainer can only be checked by size, they are padded to a multiple of 64 bytes
+    else if (bytes < NETWORK_BYTES || bytes >= NETWORK_BYTES + 64)
+        return reject(fmt::format("expected {} bytes of weights for this architecture but found {}", NETWORK_BYTES, bytes));
+
+    // The weights can be used where they are when they are already in the in memory layout
+    if (borrow && BORROWABLE_LAYOUT && IS_LITTLE_ENDIAN && reinterpret_cast<uintptr_t>(payload) % ALIGNMENT == 0) {
+        weights = reinterpret_cast<const NetworkWeights*>(payload);
+        owned   = nullptr;
+        mapped  = nullptr;
+        std::iota(hiddenOrder.begin(), hiddenOrder.end(), 0);
+        return true;
     }
 
-    // Load weightsToOut
-    for (usize i = 0; i < weightsToOut.size(); ++i) {
-        for (usize j = 0; j < weightsToOut[i].size(); j++) {
-            weightsToOut[i][j] = readLittleEndian<i16>(stream);
+    auto decoded = std::make_unique<NetworkWeights>();
+
+    // Nothing has been swapped in yet, so a net that can't be narrowed leaves the current one loaded
+    const usize clamped = decodeWeights(payload, decoded->weightsToHL.data(), decoded->weightsToHL.size());
+    if (clamped > 0)
+        return reject(fmt::format("{} feature transformer weights do not fit in {} bits, the net needs a smaller QA", clamped, sizeof(FTWeight) * 8));
+
+    decodeWeights(payload, decoded->hiddenLayerBias.data(), decoded->hiddenLayerBias.size());
+    for (auto& bucket : decoded->weightsToOut)
+        decodeWeights(payload, bucket.data(), bucket.size());
+    decodeWeights(payload, decoded->outputBias.data(), decoded->outputBias.size());
+
+    for (auto& bucket : decoded->l1Weights) {
+        array<i16, L2_SIZE> row;
+        for (usize input = 0; input < HL_SIZE * 2; input++) {
+            decodeWeights(payload, row.data(), row.size());
+            for (usize output = 0; output < L2_SIZE; output++)
+                bucket[l1Index(input, output)] = row[output];
         }
     }
+    for (auto& bucket : decoded->l1Bias)
+        decodeFloats(payload, bucket.data(), bucket.size());
+    for (auto& bucket : decoded->l2Weights)
+        decodeFloats(payload, bucket.data(), bucket.size());
+    for (auto& bucket : decoded->l2Bias)
+        decodeFloats(payload, bucket.data(), bucket.size());
+    for (auto& bucket : decoded->l3Weights)
+        decodeFloats(payload, bucket.data(), bucket.size());
+    decodeFloats(payload, decoded->l3Bias.data(), decoded->l3Bias.size());
+
+    // Only the sparse first dense layer cares about the order of the hidden neurons
+    array<u16, HL_SIZE> order;
+    std::iota(order.begin(), order.end(), 0);
+    if constexpr (L2_SIZE > 0) {
+        order = sparsityOrder(*decoded);
+        permuteHidden(*decoded, order);
+    }
+
+    owned       = std::move(decoded);
+    weights     = owned.get();
+    mapped      = nullptr;
+    hiddenOrder = order;
+    return true;
+}
+
+bool NNUE::saveNetwork(const string& filepath) const {
+    // Files keep the neuron order of the trainer, so a reordered net is put back first
+    const NetworkWeights*           net = weights;
+    std::unique_ptr<NetworkWeights> fileOrder;
+    if (!std::is_sorted(hiddenOrder.begin(), hiddenOrder.end())) {
+        array<u16, HL_SIZE> inverse;
+        for (usize i = 0; i < HL_SIZE; i++)
+            inverse[hiddenOrder[i]] = i;
+
+        fileOrder = std::make_unique<NetworkWeights>(*weights);
+        permuteHidden(*fileOrder, inverse);
+        net = fileOrder.get();
+    }
 
-    // Load outputBias
-    for (usize i = 0; i < outputBias.size(); ++i) {
-        outputBias[i] = readLittleEndian<i16>(stream);
+    std::vector<u8> payload;
+    payload.reserve(NETWORK_BYTES);
+
+    auto encodeValue = [&](i16 value) {
+        payload.push_back(static_cast<u16>(value) & 0xFF);
+        payload.push_back(static_cast<u16>(value) >> 8);
+    };
+
+    auto encode = [&](const auto& values) {
+        for (const auto value : values) {
+            if constexpr (std::is_same_v<std::decay_t<decltype(value)>, float>) {
+                u32 bits;
+                std::memcpy(&bits, &value, sizeof(bits));
+                for (usize byte = 0; byte < sizeof(bits); byte++)
+                    payload.push_back(bits >> (byte * 8) & 0xFF);
+            }
+            else
+                encodeValue(value);
+        }
+    };
+
+    encode(net->weightsToHL);
+    encode(net->hiddenLayerBias);
+    for (const auto& bucket : net->weightsToOut)
+        encode(bucket);
+    encode(net->outputBias);
+
+    for (const auto& bucket : net->l1Weights)
+        for (usize input = 0; input < HL_SIZE * 2; input++)
+            for (usize output = 0; output < L2_SIZE; output++)
+                encodeValue(bucket[l1Index(input, output)]);
+    for (const auto& bucket : net->l1Bias)
+        encode(bucket);
+    for (const auto& bucket : net->l2Weights)
+        encode(bucket);
+    for (const auto& bucket : net->l2Bias)
+        encode(bucket);
+    for (const auto& bucket : net->l3Weights)
+        encode(bucket);
+    encode(net->l3Bias);
+
+    assert(payload.size() == NETWORK_BYTES);
+
+    const NetworkFileHeader header{NETWORK_FILE_MAGIC, NETWORK_FILE_VERSION, ACTIVATION, 768, HL_SIZE, OUTPUT_BUCKETS, L2_SIZE, DENSE_L3_SIZE, QA, QB, QL1, fnv1a(payload.data(), payload.size())};
+
+    std::ofstream stream(filepath, std::ios::binary | std::ios::trunc);
+    stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    stream.write(reinterpret_cast<const char*>(payload.data()), payload.size());
+
+    if (!stream) {
+        cout << "info string Failed to write the network to " << filepath << endl;
+        return false;
     }
+
+    cout << "info string Saved the network to " << filepath << endl;
+    return true;
 }
 
-// Returns the output of the NN
-int NNUE::forwardPass(const Board* board, const AccumulatorPair& accumulators) {
-    const usize divisor      = 32 / OUTPUT_BUCKETS;
-    const usize outputBucket = (popcount(board->pieces()) - 2) / divisor;
+// Output buckets split the positions by how many pieces are left
+usize NNUE::outputBucketOf(const Board& board) {
+    const usize divisor = 32 / OUTPUT_BUCKETS;
+    return (popcount(board.pieces()) - 2) / divisor;
+}
 
-    const Accumulator& accumulatorSTM = board->stm == WHITE ? accumulators.white : accumulators.black;
-    const Accumulator& accumulatorOPP = ~board->stm == WHITE ? accumulators.white : accumulators.black;
+int NNUE::scaleOutput(i64 eval, usize outputBucket) const {
+    // Dequantization
+    if constexpr (ACTIVATION == ::SCReLU)
+        eval /= QA;
+
+    eval += weights->outputBias[outputBucket];
+
+    // Apply output bias and scale the result
+    return (eval * EVAL_SCALE) / (QA * QB);
+}
+
+int NNUE::denseLayers(const i32* l1Sums, usize outputBucket) const {
+    constexpr float L1_SCALE = 1.0f / (QA * QL1);
+
+    auto activate = [](float x) {
+        x = std::clamp(x, 0.0f, 1.0f);
+        return x * x;
+    };
+
+    array<float, L2_SIZE> l2Inputs;
+    for (usize i = 0; i < L2_SIZE; i++)
+        l2Inputs[i] = activate(l1Sums[i] * L1_SCALE + weights->l1Bias[outputBucket][i]);
+
+    array<float, DENSE_L3_SIZE> l3Inputs = weights->l2Bias[outputBucket];
+    for (usize i = 0; i < L2_SIZE; i++)
+        for (usize j = 0; j < DENSE_L3_SIZE; j++)
+            l3Inputs[j] += l2Inputs[i] * weights->l2Weights[outputBucket][i * DENSE_L3_SIZE + j];
+
+    float output = weights->l3Bias[outputBucket];
+    for (usize j = 0; j < DENSE_L3_SIZE; j++)
+        output += activate(l3Inputs[j]) * weights->l3Weights[outputBucket][j];
+
+    return static_cast<int>(output * EVAL_SCALE);
+}
+
+int NNUE::outputOf(const Accumulator& stm, const Accumulator& nstm, usize outputBucket) {
+    if constexpr (L2_SIZE > 0) {
+        alignas(ALIGNMENT) array<i32, L2_SIZE> l1Sums;
+        Kernels::active.sparseL1(stm.data(), nstm.data(), weights->l1Weights[outputBucket].data(), l1Sums.data());
+        return denseLayers(l1Sums.data(), outputBucket);
+    }
 
     // Accumulate output for STM and OPP using separate weight segments
     i64 eval = 0;
@@ -210,35 +419,101 @@ int NNUE::forwardPass(const Board* board, const AccumulatorPair& accumulators) {
         for (usize i = 0; i < HL_SIZE; i++) {
             // First HL_SIZE weights are for STM
             if constexpr (ACTIVATION == ::ReLU)
-                eval += ReLU(accumulatorSTM[i]) * weightsToOut[outputBucket][i];
+                eval += ReLU(stm[i]) * weights->weightsToOut[outputBucket][i];
             if constexpr (ACTIVATION == ::CReLU)
-                eval += CReLU(accumulatorSTM[i]) * weightsToOut[outputBucket][i];
+                eval += CReLU(stm[i]) * weights->weightsToOut[outputBucket][i];
 
             // Last HL_SIZE weights are for OPP
             if constexpr (ACTIVATION == ::ReLU)
-                eval += ReLU(accumulatorOPP[i]) * weightsToOut[outputBucket][HL_SIZE + i];
+                eval += ReLU(nstm[i]) * weights->weightsToOut[outputBucket][HL_SIZE + i];
             if constexpr (ACTIVATION == ::CReLU)
-                eval += CReLU(accumulatorOPP[i]) * weightsToOut[outputBucket][HL_SIZE + i];
+                eval += CReLU(nstm[i]) * weights->weightsToOut[outputBucket][HL_SIZE + i];
         }
     }
     else
-        eval = vectorizedSCReLU(accumulatorSTM, accumulatorOPP, outputBucket);
+        eval = vectorizedSCReLU(stm, nstm, outputBucket);
 
+    return scaleOutput(eval, outputBucket);
+}
 
-    // Dequantization
-    if constexpr (ACTIVATION == ::SCReLU)
-        eval /= QA;
+// Returns the output of the NN
+int NNUE::forwardPass(const Board* board, const AccumulatorPair& accumulators) {
+    const Accumulator& accumulatorSTM = board->stm == WHITE ? accumulators.white : accumulators.black;
+    const Accumulator& accumulatorOPP = ~board->stm == WHITE ? accumulators.white : accumulators.black;
 
-    eval += outputBias[outputBucket];
+    return outputOf(accumulatorSTM, accumulatorOPP, outputBucketOf(*board));
+}
 
-    // Apply output bias and scale the result
-    return (eval * EVAL_SCALE) / (QA * QB);
+void NNUE::evaluateBatch(const std::vector<Board>& boards, std::vector<i32>& scores, usize threadCount) {
+    scores.resize(boards.size());
+
+    // Each thread takes one contiguous run, consecutive positions from a game differ by a few pieces so the refresh
+    // cache only has to apply a handful of (still cached) weight rows for each of them
+    auto evaluateRange = [&](usize start, usize end) {
+        auto                                   cache        = std::make_unique<RefreshCache>();
+        auto                                   accumulators = std::make_unique<array<AccumulatorPair, Kernels::BATCH_SIZE>>();
+        array<usize, Kernels::BATCH_SIZE>      buckets;
+        array<const i16*, Kernels::BATCH_SIZE> stmPointers;
+        array<const i16*, Kernels::BATCH_SIZE> nstmPointers;
+        array<usize, Kernels::BATCH_SIZE>      members;
+        array<i32, Kernels::BATCH_SIZE>        outputs;
+
+        cache->reset();
+
+        for (usize first = start; first < end; first += Kernels::BATCH_SIZE) {
+            const usize count = std::min(Kernels::BATCH_SIZE, end - first);
+
+            for (usize i = 0; i < count; i++) {
+                cache->refresh(boards[first + i], (*accumulators)[i]);
+                buckets[i] = outputBucketOf(boards[first + i]);
+            }
+
+            if constexpr (ACTIVATION != ::SCReLU || L2_SIZE > 0) {
+                for (usize i = 0; i < count; i++)
+                    scores[first + i] = forwardPass(&boards[first + i], (*accumulators)[i]);
+                continue;
+            }
+
+            // Positions on the same output bucket go through the output layer together, sharing each weight load
+            array<bool, Kernels::BATCH_SIZE> done{};
+            for (usize i = 0; i < count; i++) {
+                if (done[i])
+                    continue;
+
+                usize memberCount = 0;
+                for (usize j = i; j < count; j++) {
+                    if (done[j] || buckets[j] != buckets[i])
+                        continue;
+                    const Board& board        = boards[first + j];
+                    stmPointers[memberCount]  = (board.stm == WHITE ? (*accumulators)[j].white : (*accumulators)[j].black).data();
+                    nstmPointers[memberCount] = (board.stm == WHITE ? (*accumulators)[j].black : (*accumulators)[j].white).data();
+                    members[memberCount++]    = j;
+                    done[j]                   = true;
+                }
+
+                Kernels::active.screluBatch(stmPointers.data(), nstmPointers.data(), weights->weightsToOut[buckets[i]].data(), memberCount, outputs.data());
+                for (usize m = 0; m < memberCount; m++)
+                    scores[first + members[m]] = scaleOutput(outputs[m], buckets[i]);
+            }
+        }
+    };
+
+    threadCount = std::max<usize>(std::min(threadCount, boards.size()), 1);
+
+    std::vector<std::thread> threads;
+    for (usize thread = 1; thread < threadCount; thread++)
+        threads.emplace_back(evaluateRange, boards.size() * thread / threadCount, boards.size() * (thread + 1) / threadCount);
+
+    evaluateRange(0, boards.size() / threadCount);
+
+    for (std::thread& t : threads)
+        if (t.joinable())
+            t.join();
 }
 
 // Debug feature based on SF
 void NNUE::showBuckets(const Board* board, const AccumulatorPair& accumulators) {
-    const usize divisor     = 32 / OUTPUT_BUCKETS;
-    const usize usingBucket = (popcount(board->pieces()) - 2) / divisor;
+    const usize usingBucket = outputBucketOf(*board);
 
     int staticEval = 0;
 
@@ -250,36 +525,7 @@ void NNUE::showBuckets(const Board* board, const AccumulatorPair& accumulators)
     const Accumulator& accumulatorOPP = ~board->stm == WHITE ? accumulators.white : accumulators.black;
 
     for (usize outputBucket = 0; outputBucket < OUTPUT_BUCKETS; outputBucket++) {
-        // Accumulate output for STM and OPP using separate weight segments
-        i64 eval = 0;
-
-        if constexpr (ACTIVATION != ::SCReLU) {
-            for (usize i = 0; i < HL_SIZE; i++) {
-                // First HL_SIZE weights are for STM
-                if constexpr (ACTIVATION == ::ReLU)
-                    eval += ReLU(accumulatorSTM[i]) * weightsToOut[outputBucket][i];
-                if constexpr (ACTIVATION == ::CReLU)
-                    eval += CReLU(accumulatorSTM[i]) * weightsToOut[outputBucket][i];
-
-                // Last HL_SIZE weights are for OPP
-                if constexpr (ACTIVATION == ::ReLU)
-                    eval += ReLU(accumulatorOPP[i]) * weightsToOut[outputBucket][HL_SIZE + i];
-                if constexpr (ACTIVATION == ::CReLU)
-                    eval += CReLU(accumulatorOPP[i]) * weightsToOut[outputBucket][HL_SIZE + i];
-            }
-        }
-        else
-            eval = vectorizedSCReLU(accumulatorSTM, accumulatorOPP, outputBucket);
-
-
-        // Dequantization
-        if constexpr (ACTIVATION == ::SCReLU)
-            eval /= QA;
-
-        eval += outputBias[outputBucket];
-
-        // Apply output bias and scale the result
-        staticEval = (eval * EVAL_SCALE) / (QA * QB);
+        staticEval = outputOf(accumulatorSTM, accumulatorOPP, outputBucket);
 
         cout << "| " << padStr(std::to_string(outputBucket), 11, 0) << "|  " << (staticEval > 0 ? "+" : "-") << " " << padStr(fmt::format("{:.2f}", std::abs(staticEval / 100.0)), 8, 0) << "|";
         if (outputBucket == usingBucket)
@@ -291,12 +537,13 @@ void NNUE::showBuckets(const Board* board, const AccumulatorPair& accumulators)
 }
 
 i16 NNUE::evaluate(const Board& board, Search::ThreadInfo& thisThread) {
+    const AccumulatorPair& accumulators = thisThread.accumulators();
     #ifndef NDEBUG
     AccumulatorPair verifAccumulator;
     verifAccumulator.resetAccumulators(board);
-    if (verifAccumulator != thisThread.accumulatorStack.top())
+    if (verifAccumulator != accumulators)
         board.display();
-    assert(verifAccumulator == thisThread.accumulatorStack.top());
+    assert(verifAccumulator == accumulators);
     #endif
-    return std::clamp(forwardPass(&board, thisThread.accumulatorStack.top()), static_cast<int>(Search::TB_MATED_IN_MAX_PLY), static_cast<int>(Search::TB_MATE_IN_MAX_PLY));
+    return std::clamp(forwardPass(&board, accumulators), static_cast<int>(Search::TB_MATED_IN_MAX_PLY), static_cast<int>(Search::TB_MATE_IN_MAX_PLY));
 }
\ No newline at end of file
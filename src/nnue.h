@@ -4,18 +4,45 @@
 #include "config.h"
 #include "thread.h"
 #include "accumulator.h"
+#include "memory.h"
 
-#ifdef __AVX512F__
-constexpr usize ALIGNMENT = 64;
-#else
-constexpr usize ALIGNMENT = 32;
-#endif
+#include <memory>
 
-struct NNUE {
-    alignas(ALIGNMENT) array<i16, HL_SIZE * 768> weightsToHL;
+// Sizes of the layers after the feature transformer, each architecture leaves the layers of the other one empty
+constexpr usize OUTPUT_LAYER_INPUTS = L2_SIZE == 0 ? HL_SIZE * 2 : 0;
+constexpr usize OUTPUT_LAYER_BIASES = L2_SIZE == 0 ? OUTPUT_BUCKETS : 0;
+constexpr usize DENSE_L3_SIZE       = L2_SIZE == 0 ? 0 : L3_SIZE;
+constexpr usize DENSE_L3_BIASES     = L2_SIZE == 0 ? 0 : OUTPUT_BUCKETS;
+
+// For the single layer net with i16 weights on a little endian host this is byte for byte the layout of a network file
+struct NetworkWeights {
+    alignas(ALIGNMENT) array<FTWeight, HL_SIZE * 768> weightsToHL;
     alignas(ALIGNMENT) array<i16, HL_SIZE> hiddenLayerBias;
-    alignas(ALIGNMENT) MultiArray<i16, OUTPUT_BUCKETS, HL_SIZE * 2> weightsToOut;
-    array<i16, OUTPUT_BUCKETS> outputBias;
+    alignas(ALIGNMENT) MultiArray<i16, OUTPUT_BUCKETS, OUTPUT_LAYER_INPUTS> weightsToOut;
+    array<i16, OUTPUT_LAYER_BIASES> outputBias;
+
+    // Files store the first dense layer input by input, here the weights of each pair of inputs are interleaved
+    // for every output, so the sparse kernel multiplies both inputs of a pair with one instruction
+    alignas(ALIGNMENT) MultiArray<i16, OUTPUT_BUCKETS, HL_SIZE * 2 * L2_SIZE> l1Weights;
+    MultiArray<float, OUTPUT_BUCKETS, L2_SIZE> l1Bias;
+    MultiArray<float, OUTPUT_BUCKETS, L2_SIZE * DENSE_L3_SIZE> l2Weights;
+    MultiArray<float, OUTPUT_BUCKETS, DENSE_L3_SIZE> l2Bias;
+    MultiArray<float, OUTPUT_BUCKETS, DENSE_L3_SIZE> l3Weights;
+    array<float, DENSE_L3_BIASES> l3Bias;
+};
+
+struct NNUE {
+    // Points into the embedded net, into a read-only mapping of the net file, or at a private copy
+    // The first two live in the page cache, so every engine process on the host shares one copy of them
+    const NetworkWeights* weights = nullptr;
+
+   private:
+    std::unique_ptr<NetworkWeights>     owned;
+    std::unique_ptr<Memory::MappedFile> mapped;
+    // Hidden neurons can be reordered on load to suit the kernels, neuron hiddenOrder[i] of the file is at position i
+    array<u16, HL_SIZE> hiddenOrder;
+
+   public:
 
     static i16 ReLU(const i16 x);
     static i16 CReLU(const i16 x);
@@ -25,9 +52,29 @@ struct NNUE {
 
     static usize feature(Color perspective, Color color, PieceType piece, Square square);
 
-    void loadNetwork(const string& filepath);
+    // Nets are always stored with i16 weights, they are narrowed here when QA selects i8 weights and rejected if they don't fit
+    // The file is validated against this build before anything is replaced, on failure the current net is kept
+    // With share set the weights are used in place from a read-only mapping of the file whenever the build allows it
+    bool loadNetwork(const string& filepath, bool share = false);
+    // Borrowed data must outlive the net, as the weights may point straight into it
+    bool loadNetwork(const u8* data, usize bytes, const string& name, bool borrow = false);
+    // Whether the weights are used in place rather than copied into this process
+    bool isShared() const { return weights != owned.get(); }
+
+    // Writes the net with a header describing its architecture and a checksum of the weights
+    bool saveNetwork(const string& filepath) const;
+
+    static usize outputBucketOf(const Board& board);
+    // Dequantises the output layer sum and applies the bias of its bucket
+    int scaleOutput(i64 eval, usize outputBucket) const;
+    // Runs every layer after the feature transformer for one bucket, returning the scaled eval
+    int outputOf(const Accumulator& stm, const Accumulator& nstm, usize outputBucket);
+    // The float layers of a multi layer net, from the integer sums of the first dense layer
+    int denseLayers(const i32* l1Sums, usize outputBucket) const;
 
     int  forwardPass(const Board* board, const AccumulatorPair& accumulators);
+    // Raw evals of every board from the side to move's view, the same as forwardPass, spread over threadCount threads
+    void evaluateBatch(const std::vector<Board>& boards, std::vector<i32>& scores, usize threadCount);
     void showBuckets(const Board* board, const AccumulatorPair& accumulators);
 
     i16 evaluate(const Board& board, Search::ThreadInfo& thisThread);
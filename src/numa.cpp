@@ -0,0 +1,102 @@
+#include "numa.h"
+
+#include <cctype>
+#include <thread>
+#include <fstream>
+#include <sstream>
+
+#ifdef __linux__
+    #include <pthread.h>
+    #include <sched.h>
+    #include <unistd.h>
+    #include <sys/syscall.h>
+#endif
+
+namespace Numa {
+// Value of MPOL_INTERLEAVE from linux/mempolicy.h, spelled out to avoid depending on the kernel headers
+constexpr int INTERLEAVE_POLICY = 3;
+
+// Parses a /sys list such as "0-15,32-47"
+static std::vector<usize> parseList(const string& list) {
+    std::vector<usize> values;
+    std::stringstream  ss(list);
+    string             range;
+
+    while (std::getline(ss, range, ',')) {
+        if (range.empty() || !std::isdigit(range[0]))
+            continue;
+        const usize dash  = range.find('-');
+        const usize first = std::stoull(range.substr(0, dash));
+        const usize last  = dash == string::npos ? first : std::stoull(range.substr(dash + 1));
+        for (usize value = first; value <= last; value++)
+            values.push_back(value);
+    }
+
+    return values;
+}
+
+static string readLine(const string& path) {
+    std::ifstream file(path);
+    string        line;
+    std::getline(file, line);
+    return line;
+}
+
+static std::vector<Node> detectNodes() {
+    std::vector<Node> found;
+
+    for (usize id : parseList(readLine("/sys/devices/system/node/online"))) {
+        Node node{id, parseList(readLine("/sys/devices/system/node/node" + std::to_string(id) + "/cpulist"))};
+        // Memory only nodes have no CPUs to run threads on
+        if (!node.cpus.empty())
+            found.push_back(node);
+    }
+
+    if (found.empty()) {
+        Node node{0, {}};
+        for (usize cpu = 0; cpu < std::max(std::thread::hardware_concurrency(), 1U); cpu++)
+            node.cpus.push_back(cpu);
+        found.push_back(node);
+    }
+
+    return found;
+}
+
+const std::vector<Node>& nodes() {
+    static const std::vector<Node> detected = detectNodes();
+    return detected;
+}
+
+const Node& nodeOf(usize threadId) { return nodes()[threadId % nodes().size()]; }
+
+void bindThread(usize threadId) {
+    if (nodes().size() < 2)
+        return;
+
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (usize cpu : nodeOf(threadId).cpus)
+        if (cpu < CPU_SETSIZE)
+            CPU_SET(cpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+}
+
+void interleave(void* ptr, usize bytes) {
+    if (nodes().size() < 2 || ptr == nullptr)
+        return;
+
+#if defined(__linux__) && defined(SYS_mbind)
+    constexpr usize           BITS = sizeof(unsigned long) * 8;
+    std::vector<unsigned long> mask(nodes().back().id / BITS + 1, 0);
+    for (const Node& node : nodes())
+        mask[node.id / BITS] |= 1UL << (node.id % BITS);
+
+    // Best effort, the table still works with the default policy if the kernel refuses
+    syscall(SYS_mbind, ptr, bytes, INTERLEAVE_POLICY, mask.data(), mask.size() * BITS + 1, 0);
+#else
+    (void) bytes;
+#endif
+}
+}
\ No newline at end of file
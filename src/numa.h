@@ -0,0 +1,23 @@
+#pragma once
+
+#include "types.h"
+
+namespace Numa {
+// One NUMA node and the logical CPUs that belong to it
+struct Node {
+    usize              id;
+    std::vector<usize> cpus;
+};
+
+// The nodes of this machine, read once from /sys. Without NUMA (or /sys) this is a single node holding every CPU
+const std::vector<Node>& nodes();
+
+// Node that thread number threadId runs on, threads are dealt out to the nodes in turn
+const Node& nodeOf(usize threadId);
+
+// Restricts the calling thread to the CPUs of the node for threadId. Does nothing on single node machines
+void bindThread(usize threadId);
+
+// Asks the kernel to spread the pages of a mapped range over every node as they are first touched
+void interleave(void* ptr, usize bytes);
+}
\ No newline at end of file
@@ -9,7 +9,11 @@
 #include "movepicker.h"
 #include "wdl.h"
 
+#include "../external/fmt/fmt/format.h"
+
 #include <cmath>
+#include <random>
+#include <algorithm>
 
 namespace Search {
 MultiArray<int, 2, MAX_PLY + 1, 219> lmrTable;
@@ -31,23 +35,37 @@ void                                 fillLmrTable() {
             }
 }
 
+#ifdef TT_STATS
+void recordProbe(ThreadInfo& thisThread, const Transposition& ttEntry, u64 key) {
+    TT_STAT(thisThread, probes);
+    if (ttEntry.zobrist == key)
+        TT_STAT(thisThread, hits);
+    else if (thisThread.TT.clusterFull(key))
+        TT_STAT(thisThread, collisions);
+}
+#endif
+
 // Quiesence search
 template<NodeType isPV>
 i16 qsearch(Board& board, usize ply, int alpha, int beta, SearchStack* ss, ThreadInfo& thisThread, SearchLimit& sl) {
     if (ply > thisThread.seldepth)
         thisThread.seldepth = ply;
 
-    Transposition* ttEntry = thisThread.TT.getEntry(board.zobrist);
+    Transposition ttEntry = thisThread.TT.getEntry(board.zobrist);
+#ifdef TT_STATS
+    recordProbe(thisThread, ttEntry, board.zobrist);
+#endif
 
-    if (!isPV && ttEntry->zobrist == board.zobrist
-        && (ttEntry->flag == EXACT                                       // Exact score
-            || (ttEntry->flag == BETA_CUTOFF && ttEntry->score >= beta)  // Lower bound, fail high
-            || (ttEntry->flag == FAIL_LOW && ttEntry->score <= alpha)    // Upper bound, fail low
+    if (!isPV && ttEntry.zobrist == board.zobrist
+        && (ttEntry.flag == EXACT                                      // Exact score
+            || (ttEntry.flag == BETA_CUTOFF && ttEntry.score >= beta)  // Lower bound, fail high
+            || (ttEntry.flag == FAIL_LOW && ttEntry.score <= alpha)    // Upper bound, fail low
             )) {
-        return ttEntry->score;
+        TT_STAT(thisThread, cutoffs);
+        return ttEntry.score;
     }
 
-    int staticEval = nnue.evaluate(board, thisThread);
+    int staticEval = ttEntry.zobrist == board.zobrist && ttEntry.staticEval != TT_NO_EVAL ? ttEntry.staticEval : nnue.evaluate(board, thisThread);
     if (ply >= MAX_PLY)
         return staticEval;
     if constexpr (isPV)
@@ -112,10 +130,12 @@ i16 qsearch(Board& board, usize ply, int alpha, int beta, SearchStack* ss, Threa
         }
     }
 
-    Transposition newEntry = Transposition(board.zobrist, ttFlag == FAIL_LOW ? ttEntry->move : bestMove, ttFlag, bestScore, 0);
+    Transposition newEntry = Transposition(board.zobrist, ttFlag == FAIL_LOW ? ttEntry.move : bestMove, ttFlag, bestScore, 0, staticEval);
 
-    if (thisThread.TT.shouldReplace(*ttEntry, newEntry))
+    if (thisThread.TT.shouldReplace(ttEntry, newEntry))
         thisThread.TT.setEntry(board.zobrist, newEntry);
+    else
+        TT_STAT(thisThread, refused);
 
     return bestScore;
 }
@@ -143,16 +163,20 @@ i32 search(Board& board, i32 depth, usize ply, int alpha, int beta, SearchStack*
             return alpha;
     }
 
-    Transposition* ttEntry = thisThread.TT.getEntry(board.zobrist);
-    bool           ttHit   = ss->excluded.isNull() && ttEntry->zobrist == board.zobrist;
+    Transposition ttEntry = thisThread.TT.getEntry(board.zobrist);
+    bool          ttHit   = ss->excluded.isNull() && ttEntry.zobrist == board.zobrist;
+#ifdef TT_STATS
+    recordProbe(thisThread, ttEntry, board.zobrist);
+#endif
 
     // TT cutoffs
-    if (!isPV && ttHit && ttEntry->depth >= depth
-        && (ttEntry->flag == EXACT                                       // Exact score
-            || (ttEntry->flag == BETA_CUTOFF && ttEntry->score >= beta)  // Lower bound, fail high
-            || (ttEntry->flag == FAIL_LOW && ttEntry->score <= alpha)    // Upper bound, fail low
+    if (!isPV && ttHit && ttEntry.depth >= depth
+        && (ttEntry.flag == EXACT                                      // Exact score
+            || (ttEntry.flag == BETA_CUTOFF && ttEntry.score >= beta)  // Lower bound, fail high
+            || (ttEntry.flag == FAIL_LOW && ttEntry.score <= alpha)    // Upper bound, fail low
             )) {
-        const i32& ttScore = ttEntry->score;
+        TT_STAT(thisThread, cutoffs);
+        const i32& ttScore = ttEntry.score;
         if (isLoss(ttScore))
             return ttScore + ply;
         else if (isWin(ttScore))
@@ -186,7 +210,7 @@ i32 search(Board& board, i32 depth, usize ply, int alpha, int beta, SearchStack*
 
             if (flag == EXACT || flag == FAIL_LOW && score <= alpha || flag == BETA_CUTOFF && score >= beta) {
                 // Save updated TT entry and return
-                *ttEntry = Transposition(board.zobrist, Move::null(), flag, score, depth);
+                thisThread.TT.setEntry(board.zobrist, Transposition(board.zobrist, Move::null(), flag, score, depth));
                 return score;
             }
 
@@ -203,11 +227,12 @@ i32 search(Board& board, i32 depth, usize ply, int alpha, int beta, SearchStack*
     }
 
     // Internal iterative reductions
-    if (ss->excluded.isNull() && (ttEntry->zobrist != board.zobrist || ttEntry->move.isNull()) && depth > 5)
+    if (ss->excluded.isNull() && (ttEntry.zobrist != board.zobrist || ttEntry.move.isNull()) && depth > 5)
         depth--;
 
     ss->conthist   = nullptr;
-    ss->staticEval = nnue.evaluate(board, thisThread);
+    // The eval only depends on the position, so it can be reused even inside a singular search
+    ss->staticEval = ttEntry.zobrist == board.zobrist && ttEntry.staticEval != TT_NO_EVAL ? ttEntry.staticEval : nnue.evaluate(board, thisThread);
 
     bool improving = (ss - 2)->staticEval < ss->staticEval;
     bool oppWorsening = (ss - 1)->staticEval > -ss->staticEval;
@@ -332,8 +357,8 @@ i32 search(Board& board, i32 depth, usize ply, int alpha, int beta, SearchStack*
 
         usize extension = 0;
         // Singular extensions
-        if (ply > 0 && depth >= SE_MIN_DEPTH && ttHit && m == ttEntry->move && ttEntry->depth >= depth - 3 && ttEntry->flag != FAIL_LOW) {
-            const i32 sBeta  = std::max(-INF_INT + 1, ttEntry->score - depth * 2);
+        if (ply > 0 && depth >= SE_MIN_DEPTH && ttHit && m == ttEntry.move && ttEntry.depth >= depth - 3 && ttEntry.flag != FAIL_LOW) {
+            const i32 sBeta  = std::max(-INF_INT + 1, ttEntry.score - depth * 2);
             const i32 sDepth = (depth - 1) / 2;
 
             ss->excluded    = m;
@@ -350,7 +375,7 @@ i32 search(Board& board, i32 depth, usize ply, int alpha, int beta, SearchStack*
             else if (sBeta >= beta)
                 return sBeta;
             // Negative extentions
-            else if (ttEntry->score >= beta)
+            else if (ttEntry.score >= beta)
                 extension = -2;
         }
 
@@ -365,7 +390,7 @@ i32 search(Board& board, i32 depth, usize ply, int alpha, int beta, SearchStack*
             // Late move reduction
             i32 depthReduction = lmrTable[board.isQuiet(m)][depth][movesSearched]
                 + !isPV * LMR_NONPV
-                + (ttHit && !board.isQuiet(ttEntry->move)) * LMR_TT_NOISY;
+                + (ttHit && !board.isQuiet(ttEntry.move)) * LMR_TT_NOISY;
 
             ss->reduction = depthReduction / 1024;
 
@@ -436,10 +461,12 @@ i32 search(Board& board, i32 depth, usize ply, int alpha, int beta, SearchStack*
         else if (isWin(bestScore))
             ttScore = bestScore + ply;
 
-        Transposition newEntry = Transposition(board.zobrist, ttFlag == FAIL_LOW ? ttEntry->move : bestMove, ttFlag, ttScore, depth);
+        Transposition newEntry = Transposition(board.zobrist, ttFlag == FAIL_LOW ? ttEntry.move : bestMove, ttFlag, ttScore, depth, ss->staticEval);
 
-        if (thisThread.TT.shouldReplace(*ttEntry, newEntry))
+        if (thisThread.TT.shouldReplace(ttEntry, newEntry))
             thisThread.TT.setEntry(board.zobrist, newEntry);
+        else
+            TT_STAT(thisThread, refused);
     }
 
     return bestScore;
@@ -485,8 +512,8 @@ MoveEvaluation iterativeDeepening(Board board, ThreadInfo& thisThread, SearchPar
         u64 nodes = thisThread.nodes;
         if (searcher == nullptr)
             return nodes;
-        for (ThreadInfo& w : searcher->workerData)
-            nodes += w.nodes;
+        for (std::unique_ptr<ThreadInfo>& w : searcher->workerData)
+            nodes += w->nodes;
         return nodes;
     };
 
@@ -576,6 +603,11 @@ MoveEvaluation iterativeDeepening(Board board, ThreadInfo& thisThread, SearchPar
         }
     }
 
+#ifdef TT_STATS
+    if (isMain)
+        cout << searcher->ttStatsReport() << endl;
+#endif
+
     if (isMain)
         cout << "bestmove " << lastPV.moves[0] << endl;
 
@@ -595,64 +627,65 @@ MoveEvaluation iterativeDeepening(Board board, ThreadInfo& thisThread, SearchPar
     return MoveEvaluation(lastPV.moves[0], lastScore);
 }
 
+// Also used to find how often each hidden neuron of a net is active
+const array<string, 50> BENCH_FENS = {"r3k2r/2pb1ppp/2pp1q2/p7/1nP1B3/1P2P3/P2N1PPP/R2QK2R w KQkq a6 0 14",
+                                      "4rrk1/2p1b1p1/p1p3q1/4p3/2P2n1p/1P1NR2P/PB3PP1/3R1QK1 b - - 2 24",
+                                      "r3qbrk/6p1/2b2pPp/p3pP1Q/PpPpP2P/3P1B2/2PB3K/R5R1 w - - 16 42",
+                                      "6k1/1R3p2/6p1/2Bp3p/3P2q1/P7/1P2rQ1K/5R2 b - - 4 44",
+                                      "8/8/1p2k1p1/3p3p/1p1P1P1P/1P2PK2/8/8 w - - 3 54",
+                                      "7r/2p3k1/1p1p1qp1/1P1Bp3/p1P2r1P/P7/4R3/Q4RK1 w - - 0 36",
+                                      "r1bq1rk1/pp2b1pp/n1pp1n2/3P1p2/2P1p3/2N1P2N/PP2BPPP/R1BQ1RK1 b - - 2 10",
+                                      "3r3k/2r4p/1p1b3q/p4P2/P2Pp3/1B2P3/3BQ1RP/6K1 w - - 3 87",
+                                      "2r4r/1p4k1/1Pnp4/3Qb1pq/8/4BpPp/5P2/2RR1BK1 w - - 0 42",
+                                      "4q1bk/6b1/7p/p1p4p/PNPpP2P/KN4P1/3Q4/4R3 b - - 0 37",
+                                      "2q3r1/1r2pk2/pp3pp1/2pP3p/P1Pb1BbP/1P4Q1/R3NPP1/4R1K1 w - - 2 34",
+                                      "1r2r2k/1b4q1/pp5p/2pPp1p1/P3Pn2/1P1B1Q1P/2R3P1/4BR1K b - - 1 37",
+                                      "r3kbbr/pp1n1p1P/3ppnp1/q5N1/1P1pP3/P1N1B3/2P1QP2/R3KB1R b KQkq b3 0 17",
+                                      "8/6pk/2b1Rp2/3r4/1R1B2PP/P5K1/8/2r5 b - - 16 42",
+                                      "1r4k1/4ppb1/2n1b1qp/pB4p1/1n1BP1P1/7P/2PNQPK1/3RN3 w - - 8 29",
+                                      "8/p2B4/PkP5/4p1pK/4Pb1p/5P2/8/8 w - - 29 68",
+                                      "3r4/ppq1ppkp/4bnp1/2pN4/2P1P3/1P4P1/PQ3PBP/R4K2 b - - 2 20",
+                                      "5rr1/4n2k/4q2P/P1P2n2/3B1p2/4pP2/2N1P3/1RR1K2Q w - - 1 49",
+                                      "1r5k/2pq2p1/3p3p/p1pP4/4QP2/PP1R3P/6PK/8 w - - 1 51",
+                                      "q5k1/5ppp/1r3bn1/1B6/P1N2P2/BQ2P1P1/5K1P/8 b - - 2 34",
+                                      "r1b2k1r/5n2/p4q2/1ppn1Pp1/3pp1p1/NP2P3/P1PPBK2/1RQN2R1 w - - 0 22",
+                                      "r1bqk2r/pppp1ppp/5n2/4b3/4P3/P1N5/1PP2PPP/R1BQKB1R w KQkq - 0 5",
+                                      "r1bqr1k1/pp1p1ppp/2p5/8/3N1Q2/P2BB3/1PP2PPP/R3K2n b Q - 1 12",
+                                      "r1bq2k1/p4r1p/1pp2pp1/3p4/1P1B3Q/P2B1N2/2P3PP/4R1K1 b - - 2 19",
+                                      "r4qk1/6r1/1p4p1/2ppBbN1/1p5Q/P7/2P3PP/5RK1 w - - 2 25",
+                                      "r7/6k1/1p6/2pp1p2/7Q/8/p1P2K1P/8 w - - 0 32",
+                                      "r3k2r/ppp1pp1p/2nqb1pn/3p4/4P3/2PP4/PP1NBPPP/R2QK1NR w KQkq - 1 5",
+                                      "3r1rk1/1pp1pn1p/p1n1q1p1/3p4/Q3P3/2P5/PP1NBPPP/4RRK1 w - - 0 12",
+                                      "5rk1/1pp1pn1p/p3Brp1/8/1n6/5N2/PP3PPP/2R2RK1 w - - 2 20",
+                                      "8/1p2pk1p/p1p1r1p1/3n4/8/5R2/PP3PPP/4R1K1 b - - 3 27",
+                                      "8/4pk2/1p1r2p1/p1p4p/Pn5P/3R4/1P3PP1/4RK2 w - - 1 33",
+                                      "8/5k2/1pnrp1p1/p1p4p/P6P/4R1PK/1P3P2/4R3 b - - 1 38",
+                                      "8/8/1p1kp1p1/p1pr1n1p/P6P/1R4P1/1P3PK1/1R6 b - - 15 45",
+                                      "8/8/1p1k2p1/p1prp2p/P2n3P/6P1/1P1R1PK1/4R3 b - - 5 49",
+                                      "8/8/1p4p1/p1p2k1p/P2n1P1P/4K1P1/1P6/3R4 w - - 6 54",
+                                      "8/8/1p4p1/p1p2k1p/P2n1P1P/4K1P1/1P6/6R1 b - - 6 59",
+                                      "8/5k2/1p4p1/p1pK3p/P2n1P1P/6P1/1P6/4R3 b - - 14 63",
+                                      "8/1R6/1p1K1kp1/p6p/P1p2P1P/6P1/1Pn5/8 w - - 0 67",
+                                      "1rb1rn1k/p3q1bp/2p3p1/2p1p3/2P1P2N/PP1RQNP1/1B3P2/4R1K1 b - - 4 23",
+                                      "4rrk1/pp1n1pp1/q5p1/P1pP4/2n3P1/7P/1P3PB1/R1BQ1RK1 w - - 3 22",
+                                      "r2qr1k1/pb1nbppp/1pn1p3/2ppP3/3P4/2PB1NN1/PP3PPP/R1BQR1K1 w - - 4 12",
+                                      "2r2k2/8/4P1R1/1p6/8/P4K1N/7b/2B5 b - - 0 55",
+                                      "6k1/5pp1/8/2bKP2P/2P5/p4PNb/B7/8 b - - 1 44",
+                                      "2rqr1k1/1p3p1p/p2p2p1/P1nPb3/2B1P3/5P2/1PQ2NPP/R1R4K w - - 3 25",
+                                      "r1b2rk1/p1q1ppbp/6p1/2Q5/8/4BP2/PPP3PP/2KR1B1R b - - 2 14",
+                                      "6r1/5k2/p1b1r2p/1pB1p1p1/1Pp3PP/2P1R1K1/2P2P2/3R4 w - - 1 36",
+                                      "rnbqkb1r/pppppppp/5n2/8/2PP4/8/PP2PPPP/RNBQKBNR b KQkq c3 0 2",
+                                      "2rr2k1/1p4bp/p1q1p1p1/4Pp1n/2PB4/1PN3P1/P3Q2P/2RR2K1 w - f6 0 20",
+                                      "3br1k1/p1pn3p/1p3n2/5pNq/2P1p3/1PN3PP/P2Q1PB1/4R1K1 w - - 0 23",
+                                      "2r2b2/5p2/5k2/p1r1pP2/P2pB3/1P3P2/K1P3R1/7R w - - 23 93"};
+
 void bench() {
     u64    totalNodes  = 0;
     double totalTimeMs = 0.0;
 
     cout << "Starting benchmark with depth " << BENCH_DEPTH << endl;
 
-    array<string, 50> fens = {"r3k2r/2pb1ppp/2pp1q2/p7/1nP1B3/1P2P3/P2N1PPP/R2QK2R w KQkq a6 0 14",
-                              "4rrk1/2p1b1p1/p1p3q1/4p3/2P2n1p/1P1NR2P/PB3PP1/3R1QK1 b - - 2 24",
-                              "r3qbrk/6p1/2b2pPp/p3pP1Q/PpPpP2P/3P1B2/2PB3K/R5R1 w - - 16 42",
-                              "6k1/1R3p2/6p1/2Bp3p/3P2q1/P7/1P2rQ1K/5R2 b - - 4 44",
-                              "8/8/1p2k1p1/3p3p/1p1P1P1P/1P2PK2/8/8 w - - 3 54",
-                              "7r/2p3k1/1p1p1qp1/1P1Bp3/p1P2r1P/P7/4R3/Q4RK1 w - - 0 36",
-                              "r1bq1rk1/pp2b1pp/n1pp1n2/3P1p2/2P1p3/2N1P2N/PP2BPPP/R1BQ1RK1 b - - 2 10",
-                              "3r3k/2r4p/1p1b3q/p4P2/P2Pp3/1B2P3/3BQ1RP/6K1 w - - 3 87",
-                              "2r4r/1p4k1/1Pnp4/3Qb1pq/8/4BpPp/5P2/2RR1BK1 w - - 0 42",
-                              "4q1bk/6b1/7p/p1p4p/PNPpP2P/KN4P1/3Q4/4R3 b - - 0 37",
-                              "2q3r1/1r2pk2/pp3pp1/2pP3p/P1Pb1BbP/1P4Q1/R3NPP1/4R1K1 w - - 2 34",
-                              "1r2r2k/1b4q1/pp5p/2pPp1p1/P3Pn2/1P1B1Q1P/2R3P1/4BR1K b - - 1 37",
-                              "r3kbbr/pp1n1p1P/3ppnp1/q5N1/1P1pP3/P1N1B3/2P1QP2/R3KB1R b KQkq b3 0 17",
-                              "8/6pk/2b1Rp2/3r4/1R1B2PP/P5K1/8/2r5 b - - 16 42",
-                              "1r4k1/4ppb1/2n1b1qp/pB4p1/1n1BP1P1/7P/2PNQPK1/3RN3 w - - 8 29",
-                              "8/p2B4/PkP5/4p1pK/4Pb1p/5P2/8/8 w - - 29 68",
-                              "3r4/ppq1ppkp/4bnp1/2pN4/2P1P3/1P4P1/PQ3PBP/R4K2 b - - 2 20",
-                              "5rr1/4n2k/4q2P/P1P2n2/3B1p2/4pP2/2N1P3/1RR1K2Q w - - 1 49",
-                              "1r5k/2pq2p1/3p3p/p1pP4/4QP2/PP1R3P/6PK/8 w - - 1 51",
-                              "q5k1/5ppp/1r3bn1/1B6/P1N2P2/BQ2P1P1/5K1P/8 b - - 2 34",
-                              "r1b2k1r/5n2/p4q2/1ppn1Pp1/3pp1p1/NP2P3/P1PPBK2/1RQN2R1 w - - 0 22",
-                              "r1bqk2r/pppp1ppp/5n2/4b3/4P3/P1N5/1PP2PPP/R1BQKB1R w KQkq - 0 5",
-                              "r1bqr1k1/pp1p1ppp/2p5/8/3N1Q2/P2BB3/1PP2PPP/R3K2n b Q - 1 12",
-                              "r1bq2k1/p4r1p/1pp2pp1/3p4/1P1B3Q/P2B1N2/2P3PP/4R1K1 b - - 2 19",
-                              "r4qk1/6r1/1p4p1/2ppBbN1/1p5Q/P7/2P3PP/5RK1 w - - 2 25",
-                              "r7/6k1/1p6/2pp1p2/7Q/8/p1P2K1P/8 w - - 0 32",
-                              "r3k2r/ppp1pp1p/2nqb1pn/3p4/4P3/2PP4/PP1NBPPP/R2QK1NR w KQkq - 1 5",
-                              "3r1rk1/1pp1pn1p/p1n1q1p1/3p4/Q3P3/2P5/PP1NBPPP/4RRK1 w - - 0 12",
-                              "5rk1/1pp1pn1p/p3Brp1/8/1n6/5N2/PP3PPP/2R2RK1 w - - 2 20",
-                              "8/1p2pk1p/p1p1r1p1/3n4/8/5R2/PP3PPP/4R1K1 b - - 3 27",
-                              "8/4pk2/1p1r2p1/p1p4p/Pn5P/3R4/1P3PP1/4RK2 w - - 1 33",
-                              "8/5k2/1pnrp1p1/p1p4p/P6P/4R1PK/1P3P2/4R3 b - - 1 38",
-                              "8/8/1p1kp1p1/p1pr1n1p/P6P/1R4P1/1P3PK1/1R6 b - - 15 45",
-                              "8/8/1p1k2p1/p1prp2p/P2n3P/6P1/1P1R1PK1/4R3 b - - 5 49",
-                              "8/8/1p4p1/p1p2k1p/P2n1P1P/4K1P1/1P6/3R4 w - - 6 54",
-                              "8/8/1p4p1/p1p2k1p/P2n1P1P/4K1P1/1P6/6R1 b - - 6 59",
-                              "8/5k2/1p4p1/p1pK3p/P2n1P1P/6P1/1P6/4R3 b - - 14 63",
-                              "8/1R6/1p1K1kp1/p6p/P1p2P1P/6P1/1Pn5/8 w - - 0 67",
-                              "1rb1rn1k/p3q1bp/2p3p1/2p1p3/2P1P2N/PP1RQNP1/1B3P2/4R1K1 b - - 4 23",
-                              "4rrk1/pp1n1pp1/q5p1/P1pP4/2n3P1/7P/1P3PB1/R1BQ1RK1 w - - 3 22",
-                              "r2qr1k1/pb1nbppp/1pn1p3/2ppP3/3P4/2PB1NN1/PP3PPP/R1BQR1K1 w - - 4 12",
-                              "2r2k2/8/4P1R1/1p6/8/P4K1N/7b/2B5 b - - 0 55",
-                              "6k1/5pp1/8/2bKP2P/2P5/p4PNb/B7/8 b - - 1 44",
-                              "2rqr1k1/1p3p1p/p2p2p1/P1nPb3/2B1P3/5P2/1PQ2NPP/R1R4K w - - 3 25",
-                              "r1b2rk1/p1q1ppbp/6p1/2Q5/8/4BP2/PPP3PP/2KR1B1R b - - 2 14",
-                              "6r1/5k2/p1b1r2p/1pB1p1p1/1Pp3PP/2P1R1K1/2P2P2/3R4 w - - 1 36",
-                              "rnbqkb1r/pppppppp/5n2/8/2PP4/8/PP2PPPP/RNBQKBNR b KQkq c3 0 2",
-                              "2rr2k1/1p4bp/p1q1p1p1/4Pp1n/2PB4/1PN3P1/P3Q2P/2RR2K1 w - f6 0 20",
-                              "3br1k1/p1pn3p/1p3n2/5pNq/2P1p3/1PN3PP/P2Q1PB1/4R1K1 w - - 0 23",
-                              "2r2b2/5p2/5k2/p1r1pP2/P2pB3/1P3P2/K1P3R1/7R w - - 23 93"};
-
-    for (auto fen : fens) {
+    for (auto fen : BENCH_FENS) {
         if (fen.empty())
             continue;  // Skip empty lines
 
@@ -692,4 +725,183 @@ void bench() {
     }
     cout << totalNodes << " nodes " << nps << " nps" << endl;
 }
+
+// Makes the value look used without storing it anywhere, so whatever computed it can't be optimized away
+template<typename T>
+inline void doNotOptimize(const T& value) {
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    [[maybe_unused]] volatile T copy = value;
+#endif
+}
+
+void microbench() {
+    constexpr usize ROUNDS         = 7;
+    constexpr u64   MIN_ROUND_TIME = 20'000'000;  // In nanoseconds
+    constexpr usize TT_KEYS        = 1 << 16;
+
+    // The bench positions and every position a legal move away from them
+    std::vector<Board> roots;
+    std::vector<Board> positions;
+    for (const string& fen : BENCH_FENS) {
+        Board board;
+        board.loadFromFEN(fen);
+        roots.push_back(board);
+        positions.push_back(board);
+
+        for (Move m : Movegen::generateLegalMoves(board)) {
+            Board child = board;
+            child.move(m);
+            positions.push_back(child);
+        }
+    }
+
+    std::vector<MoveList> pseudoLegal;
+    std::vector<MoveList> legal;
+    for (Board& board : positions) {
+        pseudoLegal.push_back(Movegen::generateMoves<ALL_MOVES>(board));
+        legal.push_back(Movegen::generateLegalMoves(board));
+    }
+
+    // Accumulators of every root, and the root each move out of it starts from
+    struct Child {
+        usize     root;
+        Board     board;
+        Move      move;
+        PieceType captured;
+    };
+
+    std::vector<AccumulatorPair> rootAccumulators(roots.size());
+    std::vector<Child>           children;
+    for (usize i = 0; i < roots.size(); i++) {
+        rootAccumulators[i].resetAccumulators(roots[i]);
+        for (Move m : Movegen::generateLegalMoves(roots[i])) {
+            Board child = roots[i];
+            child.move(m);
+            children.push_back({i, child, m, roots[i].getPiece(m.to())});
+        }
+    }
+
+    TranspositionTable TT;
+    std::vector<u64>   keys(TT_KEYS);
+    std::mt19937_64    engine(0xC0FFEE);
+    for (u64& key : keys)
+        key = engine();
+
+    // Results feed into this, which is kept alive after every pass so no kernel can be optimized away
+    u64 sink = 0;
+
+    // pass runs the kernel over its whole set once and returns how many operations that was. The first rounds warm the
+    // caches up and find how many passes take at least MIN_ROUND_TIME, then the median round of ROUNDS is reported
+    auto measure = [&](const string& name, auto pass) {
+        usize passes = 1;
+        while (true) {
+            Stopwatch<std::chrono::nanoseconds> time;
+            for (usize i = 0; i < passes; i++) {
+                pass();
+                doNotOptimize(sink);
+            }
+            if (time.elapsed() >= MIN_ROUND_TIME)
+                break;
+            passes *= 2;
+        }
+
+        array<double, ROUNDS> nsPerOp;
+        for (double& result : nsPerOp) {
+            u64                                 ops = 0;
+            Stopwatch<std::chrono::nanoseconds> time;
+            for (usize i = 0; i < passes; i++) {
+                ops += pass();
+                doNotOptimize(sink);
+            }
+            result = static_cast<double>(time.elapsed()) / ops;
+        }
+        std::sort(nsPerOp.begin(), nsPerOp.end());
+
+        const double median = nsPerOp[ROUNDS / 2];
+        cout << fmt::format("{:<36}{:>10.2f} ns/op {:>16} ops/s   (min {:.2f}, max {:.2f})", name, median, formatNum(static_cast<i64>(1e9 / median)), nsPerOp.front(), nsPerOp.back())
+             << endl;
+    };
+
+    cout << "Starting microbenchmark on " << formatNum(positions.size()) << " positions, median of " << ROUNDS << " rounds" << endl;
+
+    measure("Movegen::generateMoves", [&]() {
+        for (const Board& board : positions)
+            sink += Movegen::generateMoves<ALL_MOVES>(board).length;
+        return positions.size();
+    });
+
+    measure("Board::isLegal", [&]() {
+        u64 ops = 0;
+        for (usize i = 0; i < positions.size(); i++) {
+            for (Move m : pseudoLegal[i])
+                sink += positions[i].isLegal(m);
+            ops += pseudoLegal[i].length;
+        }
+        return ops;
+    });
+
+    measure("Board::move", [&]() {
+        u64 ops = 0;
+        for (usize i = 0; i < positions.size(); i++) {
+            for (Move m : legal[i]) {
+                Board child = positions[i];
+                child.move(m);
+                sink += child.zobrist;
+            }
+            ops += legal[i].length;
+        }
+        return ops;
+    });
+
+    measure("Board::see", [&]() {
+        u64 ops = 0;
+        for (usize i = 0; i < positions.size(); i++) {
+            for (Move m : pseudoLegal[i])
+                sink += positions[i].see(m, 0);
+            ops += pseudoLegal[i].length;
+        }
+        return ops;
+    });
+
+    measure("AccumulatorPair::update", [&]() {
+        AccumulatorPair result;
+        for (const Child& child : children) {
+            result.update(child.board, child.move, child.captured);
+            result.materialize(rootAccumulators[child.root]);
+            sink += result.white[0];
+        }
+        return children.size();
+    });
+
+    measure("AccumulatorPair::resetAccumulators", [&]() {
+        AccumulatorPair accumulators;
+        for (const Board& board : roots) {
+            accumulators.resetAccumulators(board);
+            sink += accumulators.white[0];
+        }
+        return roots.size();
+    });
+
+    measure("NNUE::forwardPass", [&]() {
+        for (usize i = 0; i < roots.size(); i++)
+            sink += nnue.forwardPass(&roots[i], rootAccumulators[i]);
+        return roots.size();
+    });
+
+    measure("TranspositionTable::setEntry", [&]() {
+        for (const u64 key : keys)
+            TT.setEntry(key, Transposition(key, Move::null(), EXACT, static_cast<i16>(key), key % MAX_PLY, static_cast<i16>(key >> 16)));
+        return keys.size();
+    });
+
+    measure("TranspositionTable::getEntry", [&]() {
+        for (const u64 key : keys)
+            sink += TT.getEntry(key).zobrist == key;
+        return keys.size();
+    });
+
+    cout << "Microbenchmark completed" << endl;
+}
 }
\ No newline at end of file
@@ -95,7 +95,10 @@ inline bool isTBScore(i32 score) { return isDecisive(score) && std::abs(score) <
 
 MoveEvaluation iterativeDeepening(Board board, ThreadInfo& thisThread, SearchParams sp, Searcher* searcher = nullptr);
 
+extern const array<string, 50> BENCH_FENS;
 void bench();
+// Times movegen, SEE, the accumulators, the output layer and the TT separately, in ns per operation
+void microbench();
 
 void fillLmrTable();
 }
\ No newline at end of file
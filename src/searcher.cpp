@@ -3,24 +3,40 @@
 #include "search.h"
 #include "globals.h"
 #include "wdl.h"
+#include "numa.h"
 
 #include <algorithm>
 
 void Searcher::start(Board& board, Search::SearchParams sp) {
+    waitForBackground();
+
     time           = sp.time;
     mainData->nodes = 0;
     mainData->tbHits = 0;
-    mainThread     = std::thread(Search::iterativeDeepening, board, std::ref(*mainData), sp, this);
+#ifdef TT_STATS
+    mainData->ttStats = TTStats();
+#endif
+    mainThread     = std::thread([this, board, sp]() {
+        Numa::bindThread(0);
+        Search::iterativeDeepening(board, *mainData, sp, this);
+    });
 
     for (usize i = 0; i < workerData.size(); i++) {
-        workerData[i].nodes = 0;
-        workerData[i].tbHits = 0;
-        workers.emplace_back(Search::iterativeDeepening, board, std::ref(workerData[i]), sp, nullptr);
+        workerData[i]->nodes = 0;
+        workerData[i]->tbHits = 0;
+#ifdef TT_STATS
+        workerData[i]->ttStats = TTStats();
+#endif
+        workers.emplace_back([this, board, sp, i]() {
+            Numa::bindThread(i + 1);
+            Search::iterativeDeepening(board, *workerData[i], sp, nullptr);
+        });
     }
 }
 
 void Searcher::stop() {
     stopFlag.store(true, std::memory_order_relaxed);
+    waitForBackground();
 
     if (mainThread.joinable())
         mainThread.join();
@@ -39,22 +55,64 @@ void Searcher::makeThreads(int threads) {
     threads -= 1;
 
     stop();
+    mainData.reset();
     workerData.clear();
+    workerData.resize(threads);
+
+    // Thread data is built by a thread bound to the node that will search with it, so the pages are first touched there
+    std::vector<std::thread> builders;
+
+    builders.emplace_back([this]() {
+        Numa::bindThread(0);
+        mainData = std::make_unique<Search::ThreadInfo>(Search::ThreadType::MAIN, TT, stopFlag);
+    });
+
+    for (usize i = 0; i < workerData.size(); i++)
+        builders.emplace_back([this, i]() {
+            Numa::bindThread(i + 1);
+            workerData[i] = std::make_unique<Search::ThreadInfo>(Search::ThreadType::SECONDARY, TT, stopFlag);
+        });
+
+    for (std::thread& t : builders)
+        t.join();
 
-    for (int i = 0; i < threads; i++)
-        workerData.emplace_back(Search::ThreadType::SECONDARY, TT, stopFlag);
+    if (Numa::nodes().size() > 1)
+        cout << "info string " << threads + 1 << " threads spread over " << Numa::nodes().size() << " NUMA nodes" << endl;
+}
+
+void Searcher::reset() {
+    runInBackground([this]() {
+        TT.clear();
+
+        // Histories are reset by one thread per ThreadInfo, bound to its node so the pages stay local
+        std::vector<std::thread> threads;
+
+        threads.emplace_back([this]() {
+            Numa::bindThread(0);
+            mainData->reset();
+        });
+
+        for (usize i = 0; i < workerData.size(); i++)
+            threads.emplace_back([this, i]() {
+                Numa::bindThread(i + 1);
+                workerData[i]->reset();
+            });
+
+        for (std::thread& t : threads)
+            t.join();
+    });
 }
 
 string Searcher::searchReport(Board& board, usize depth, i32 score, PvList& pv) {
     std::ostringstream ans;
 
     u64 nodes = mainData->nodes;
-    for (Search::ThreadInfo& t : workerData)
-        nodes += t.nodes;
+    for (std::unique_ptr<Search::ThreadInfo>& t : workerData)
+        nodes += t->nodes;
 
     u64 tbHits = mainData->tbHits;
-    for (Search::ThreadInfo& t : workerData)
-        nodes += t.tbHits;
+    for (std::unique_ptr<Search::ThreadInfo>& t : workerData)
+        nodes += t->tbHits;
 
     score = std::clamp(score, mainData->minRootScore, mainData->maxRootScore);
 
@@ -87,4 +145,25 @@ string Searcher::searchReport(Board& board, usize depth, i32 score, PvList& pv)
         ans << " " << m;
 
     return ans.str();
-}
\ No newline at end of file
+}
+
+#ifdef TT_STATS
+TTStats Searcher::ttStats() {
+    TTStats stats = mainData->ttStats;
+    for (std::unique_ptr<Search::ThreadInfo>& t : workerData)
+        stats += t->ttStats;
+    return stats;
+}
+
+string Searcher::ttStatsReport() {
+    const TTStats stats   = ttStats();
+    auto          percent = [&](u64 count) { return fmt::format("{:.1f}%", stats.probes ? count * 100.0 / stats.probes : 0.0); };
+
+    std::ostringstream ans;
+    ans << "info string tt probes " << stats.probes << " hits " << stats.hits << " (" << percent(stats.hits) << ")";
+    ans << " collisions " << stats.collisions << " (" << percent(stats.collisions) << ")";
+    ans << " refused " << stats.refused << " cutoffs " << stats.cutoffs << " (" << percent(stats.cutoffs) << ")";
+    ans << " hashfull " << TT.hashfull();
+    return ans.str();
+}
+#endif
\ No newline at end of file
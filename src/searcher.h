@@ -5,41 +5,91 @@
 #include "thread.h"
 
 #include <thread>
+#include <functional>
 
 struct Searcher {
     TranspositionTable TT;
     std::atomic<bool>  stopFlag;
     Stopwatch<std::chrono::milliseconds> time;
-    std::unique_ptr<Search::ThreadInfo> mainData = std::make_unique<Search::ThreadInfo>(Search::ThreadType::MAIN, TT, stopFlag);
+    std::unique_ptr<Search::ThreadInfo> mainData;
     std::thread        mainThread;
 
-    std::vector<Search::ThreadInfo> workerData;
-    std::vector<std::thread>        workers;
+    // Each worker's data is allocated separately, so it can live on the NUMA node of the thread using it
+    std::vector<std::unique_ptr<Search::ThreadInfo>> workerData;
+    std::vector<std::thread>                         workers;
+
+    // Runs slow TT and thread data maintenance, so the UCI loop can keep reading commands meanwhile
+    std::thread background;
 
     Searcher() {
-        TT.clear();
+        makeThreads(1);
         stopFlag.store(true);
         time.reset();
         mainData->reset();
     }
 
+    ~Searcher() { stop(); }
+
     void start(Board& board, Search::SearchParams sp);
     void stop();
     void waitUntilFinished();
 
     void makeThreads(int threads);
 
+    // Waits for the previous job, then starts this one in the background
+    void runInBackground(std::function<void()> job) {
+        waitForBackground();
+        background = std::thread(std::move(job));
+    }
+    // Anything that touches the TT or thread data outside of a search must wait for the background job first
+    void waitForBackground() {
+        if (background.joinable())
+            background.join();
+    }
+
     void resizeTT(usize size) {
-        TT.reserve(size);
-        TT.clear(workerData.size() + 1);
+        waitForBackground();
+        if (TT.isShared()) {
+            cout << "info string Hash size is set by the shared hash, clear HashShared to resize" << endl;
+            return;
+        }
+        runInBackground([this, size]() {
+            // Migrating with one thread per search thread is also the first touch of the new pages
+            TT.resize(size, workerData.size() + 1);
+            cout << "info string Hash " << size << "MB allocated with " << TT.describePages() << endl;
+        });
     }
 
-    void reset() {
-        TT.clear();
-        mainData->reset();
-        for (Search::ThreadInfo& w : workerData)
-            w.reset();
+    void shareTT(const string& name) {
+        waitForBackground();
+        TT.share(name, workerData.size() + 1);
+    }
+
+    bool saveTT(const string& path) {
+        waitForBackground();
+        return TT.save(path);
+    }
+
+    bool loadTT(const string& path) {
+        waitForBackground();
+        return TT.load(path, workerData.size() + 1);
+    }
+
+    // Returns at once, the clear finishes in the background
+    void reset();
+
+    // Refresh caches hold accumulators built from the old weights
+    void networkChanged() {
+        waitForBackground();
+        mainData->refreshCache.reset();
+        for (std::unique_ptr<Search::ThreadInfo>& w : workerData)
+            w->refreshCache.reset();
     }
 
     string searchReport(Board& board, usize depth, i32 score, PvList& pv);
+
+#ifdef TT_STATS
+    TTStats ttStats();
+    string  ttStatsReport();
+#endif
 };
\ No newline at end of file
@@ -0,0 +1,157 @@
+#pragma once
+
+#include "types.h"
+
+// Thin wrappers over the native vector instructions, so each kernel is written once for every architecture
+// Only include this from source files, the macros would leak into everything that includes a header
+// Defining NO_SIMD before including it forces the scalar fallback, which the SIMD kernels are checked against
+// set1_pair_epi16 broadcasts two i16 packed into an i32 to every pair of lanes, nonzero_pairs_mask sets one bit for each
+// pair of lanes that isn't zero. Its lanes must not be negative
+
+#if !defined(NO_SIMD) && (defined(__x86_64__) || defined(__amd64__) || (defined(_WIN64) && (defined(_M_X64) || defined(_M_AMD64)) || defined(__ARM_NEON)))
+    #define HAS_SIMD
+    #ifndef __ARM_NEON
+        #include <immintrin.h>
+    #endif
+    #if defined(__AVX512F__)
+        #pragma message("Using AVX512 NNUE inference")
+        #ifdef __AVX512VNNI__
+            #define SIMD_NAME "AVX512-VNNI"
+        #else
+            #define SIMD_NAME "AVX512"
+        #endif
+using Vectori16 = __m512i;
+using Vectori32 = __m512i;
+        #define set1_epi16 _mm512_set1_epi16
+        #define load_epi16(x) _mm512_load_si512(reinterpret_cast<const Vectori16*>(x))
+        #define store_epi16(x, v) _mm512_store_si512(reinterpret_cast<Vectori16*>(x), v)
+        #define store_epi32(x, v) _mm512_store_si512(reinterpret_cast<Vectori32*>(x), v)
+        #define set1_pair_epi16 _mm512_set1_epi32
+        #define nonzero_pairs_mask(v) static_cast<u64>(_mm512_test_epi32_mask(v, v))
+        #define load_epi8_as_epi16(x) _mm512_cvtepi8_epi16(_mm256_load_si256(reinterpret_cast<const __m256i*>(x)))
+        #define add_epi16 _mm512_add_epi16
+        #define sub_epi16 _mm512_sub_epi16
+        #define min_epi16 _mm512_min_epi16
+        #define max_epi16 _mm512_max_epi16
+        #define madd_epi16 _mm512_madd_epi16
+        #define mullo_epi16 _mm512_mullo_epi16
+        #define add_epi32 _mm512_add_epi32
+        #ifdef __AVX512VNNI__
+            #define dpwssd_epi32 _mm512_dpwssd_epi32
+        #endif
+        #define reduce_epi32 _mm512_reduce_add_epi32
+    #elif defined(__AVX2__)
+        #pragma message("Using AVX2 NNUE inference")
+        #ifdef __AVXVNNI__
+            #define SIMD_NAME "AVX-VNNI"
+        #else
+            #define SIMD_NAME "AVX2"
+        #endif
+using Vectori16 = __m256i;
+using Vectori32 = __m256i;
+        #define set1_epi16 _mm256_set1_epi16
+        #define load_epi16(x) _mm256_load_si256(reinterpret_cast<const Vectori16*>(x))
+        #define store_epi16(x, v) _mm256_store_si256(reinterpret_cast<Vectori16*>(x), v)
+        #define store_epi32(x, v) _mm256_store_si256(reinterpret_cast<Vectori32*>(x), v)
+        #define set1_pair_epi16 _mm256_set1_epi32
+        #define nonzero_pairs_mask(v) static_cast<u64>(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(v, _mm256_setzero_si256()))))
+        #define load_epi8_as_epi16(x) _mm256_cvtepi8_epi16(_mm_load_si128(reinterpret_cast<const __m128i*>(x)))
+        #define add_epi16 _mm256_add_epi16
+        #define sub_epi16 _mm256_sub_epi16
+        #define min_epi16 _mm256_min_epi16
+        #define max_epi16 _mm256_max_epi16
+        #define madd_epi16 _mm256_madd_epi16
+        #define mullo_epi16 _mm256_mullo_epi16
+        #define add_epi32 _mm256_add_epi32
+        #ifdef __AVXVNNI__
+            #define dpwssd_epi32 _mm256_dpwssd_avx_epi32
+        #endif
+        #define reduce_epi32 \
+            [](Vectori32 vec) { \
+                __m128i xmm1 = _mm256_extracti128_si256(vec, 1); \
+                __m128i xmm0 = _mm256_castsi256_si128(vec); \
+                xmm0         = _mm_add_epi32(xmm0, xmm1); \
+                xmm1         = _mm_shuffle_epi32(xmm0, 238); \
+                xmm0         = _mm_add_epi32(xmm0, xmm1); \
+                xmm1         = _mm_shuffle_epi32(xmm0, 85); \
+                xmm0         = _mm_add_epi32(xmm0, xmm1); \
+                return _mm_cvtsi128_si32(xmm0); \
+            }
+    #elif defined(__ARM_NEON)
+        #include <arm_neon.h>
+        #pragma message("Using NEON NNUE inference")
+        #define SIMD_NAME "NEON"
+using Vectori16 = int16x8_t;
+using Vectori32 = int32x4_t;
+        #define set1_epi16 vdupq_n_s16
+        #define load_epi16(x) vld1q_s16(reinterpret_cast<const i16*>(x))
+        #define store_epi16(x, v) vst1q_s16(reinterpret_cast<i16*>(x), v)
+        #define store_epi32(x, v) vst1q_s32(reinterpret_cast<i32*>(x), v)
+        #define set1_pair_epi16(x) vreinterpretq_s16_s32(vdupq_n_s32(x))
+        #define nonzero_pairs_mask(v) \
+            [](Vectori16 vec) { \
+                const uint32x4_t bits = {1, 2, 4, 8}; \
+                return static_cast<u64>(vaddvq_u32(vandq_u32(vcgtq_s32(vreinterpretq_s32_s16(vec), vdupq_n_s32(0)), bits))); \
+            }(v)
+        #define load_epi8_as_epi16(x) vmovl_s8(vld1_s8(reinterpret_cast<const i8*>(x)))
+        #define add_epi16 vaddq_s16
+        #define sub_epi16 vsubq_s16
+        #define min_epi16 vminq_s16
+        #define max_epi16 vmaxq_s16
+        #define madd_epi16 \
+            [](Vectori16 a, Vectori16 b) { \
+                const Vectori32 low  = vmull_s16(vget_low_s16(a), vget_low_s16(b)); \
+                const Vectori32 high = vmull_high_s16(a, b); \
+                return vpaddq_s32(low, high); \
+            }
+        #define mullo_epi16 vmulq_s16
+        #define add_epi32 vaddq_s32
+        #define reduce_epi32 vaddvq_s32
+    #else
+        #pragma message("Using SSE NNUE inference")
+        #define SIMD_NAME "SSE"
+// Assumes SSE support here
+using Vectori16 = __m128i;
+using Vectori32 = __m128i;
+        #define set1_epi16 _mm_set1_epi16
+        #define load_epi16(x) _mm_load_si128(reinterpret_cast<const Vectori16*>(x))
+        #define store_epi16(x, v) _mm_store_si128(reinterpret_cast<Vectori16*>(x), v)
+        #define store_epi32(x, v) _mm_store_si128(reinterpret_cast<Vectori32*>(x), v)
+        #define set1_pair_epi16 _mm_set1_epi32
+        #define nonzero_pairs_mask(v) static_cast<u64>(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(v, _mm_setzero_si128()))))
+        // Plain SSE2 has no sign extension, so each byte is duplicated and shifted down arithmetically
+        #define load_epi8_as_epi16(x) \
+            [](const void* ptr) { \
+                const __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(ptr)); \
+                return _mm_srai_epi16(_mm_unpacklo_epi8(bytes, bytes), 8); \
+            }(x)
+        #define add_epi16 _mm_add_epi16
+        #define sub_epi16 _mm_sub_epi16
+        #define min_epi16 _mm_min_epi16
+        #define max_epi16 _mm_max_epi16
+        #define madd_epi16 _mm_madd_epi16
+        #define mullo_epi16 _mm_mullo_epi16
+        #define add_epi32 _mm_add_epi32
+        #define reduce_epi32 \
+            [](Vectori32 vec) { \
+                __m128i xmm1 = _mm_shuffle_epi32(vec, 238); \
+                vec          = _mm_add_epi32(vec, xmm1); \
+                xmm1         = _mm_shuffle_epi32(vec, 85); \
+                vec          = _mm_add_epi32(vec, xmm1); \
+                return _mm_cvtsi128_si32(vec); \
+            }
+    #endif
+
+    // Multiplies pairs of i16 lanes and adds both products to the i32 lane of acc. VNNI does it in one instruction
+    #ifndef dpwssd_epi32
+        #define dpwssd_epi32(acc, a, b) add_epi32(acc, madd_epi16(a, b))
+    #endif
+
+// Vector registers a kernel can keep live at once, every target here has at least 16
+constexpr usize SIMD_REGISTERS = 16;
+#else
+    #ifndef NO_SIMD
+        #pragma message("Using compiler optimized NNUE inference")
+    #endif
+    #define SIMD_NAME "scalar"
+#endif
\ No newline at end of file
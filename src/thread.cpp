@@ -10,6 +10,7 @@ ThreadInfo::ThreadInfo(ThreadType type, TranspositionTable& TT, std::atomic<bool
     deepFill(history, DEFAULT_HISTORY_VALUE);
     deepFill(conthist, DEFAULT_HISTORY_VALUE);
     deepFill(capthist, DEFAULT_HISTORY_VALUE);
+    refreshCache.reset();
     breakFlag.store(false, std::memory_order_relaxed);
 
     nodes            = 0;
@@ -24,6 +25,7 @@ ThreadInfo::ThreadInfo(const ThreadInfo& other) :
     history(other.history),
     conthist(other.conthist),
     accumulatorStack(other.accumulatorStack),
+    refreshCache(other.refreshCache),
     type(other.type),
     TT(other.TT),
     breakFlag(other.breakFlag),
@@ -32,6 +34,9 @@ ThreadInfo::ThreadInfo(const ThreadInfo& other) :
     maxRootScore(other.maxRootScore),
     rootMoves(other.rootMoves),
     minNmpPly(other.minNmpPly) {
+#ifdef TT_STATS
+    ttStats = other.ttStats;
+#endif
     nodes.store(other.nodes.load(std::memory_order_relaxed), std::memory_order_relaxed);
     tbHits.store(other.tbHits.load(std::memory_order_relaxed), std::memory_order_relaxed);
 }
@@ -64,8 +69,7 @@ void ThreadInfo::updateConthist(SearchStack* ss, Board& b, Move m, int bonus) {
 ThreadStackManager ThreadInfo::makeMove(Board& board, Board& newBoard, Move m) {
     newBoard.move(m);
 
-    accumulatorStack.push(accumulatorStack.top());
-    accumulatorStack.topAsReference().update(newBoard, m, board.getPiece(m.to()));
+    accumulatorStack.pushUninitialized().update(newBoard, m, board.getPiece(m.to()));
 
     return ThreadStackManager(*this);
 }
@@ -73,26 +77,44 @@ ThreadStackManager ThreadInfo::makeMove(Board& board, Board& newBoard, Move m) {
 ThreadStackManager ThreadInfo::makeNullMove(Board& newBoard) {
     newBoard.nullMove();
 
-    accumulatorStack.push(accumulatorStack.top());
+    accumulatorStack.pushUninitialized().updateNull();
 
     return ThreadStackManager(*this);
 }
 
+const AccumulatorPair& ThreadInfo::accumulators() {
+    // The root is always computed, so this stops. Null move entries are never computed and are walked past
+    usize source = accumulatorStack.length() - 1;
+    while (!accumulatorStack[source].computed)
+        source--;
+
+    // Each entry is built straight from the nearest real ancestor, null moves don't copy anything
+    for (usize i = source + 1; i < accumulatorStack.length(); i++) {
+        if (accumulatorStack[i].aliasesParent())
+            continue;
+        accumulatorStack[i].materialize(accumulatorStack[source]);
+        source = i;
+    }
+
+    return accumulatorStack[source];
+}
+
 void ThreadInfo::refresh(Board& b) {
     accumulatorStack.clear();
-
-    AccumulatorPair accumulators;
-    accumulators.resetAccumulators(b);
-    accumulatorStack.push(accumulators);
+    refreshCache.refresh(b, accumulatorStack.pushUninitialized());
 }
 
 void ThreadInfo::reset() {
     deepFill(history, DEFAULT_HISTORY_VALUE);
     deepFill(conthist, DEFAULT_HISTORY_VALUE);
     deepFill(capthist, DEFAULT_HISTORY_VALUE);
+    refreshCache.reset();
 
     nodes.store(0, std::memory_order_relaxed);
     tbHits.store(0, std::memory_order_relaxed);
+#ifdef TT_STATS
+    ttStats = TTStats();
+#endif
     seldepth = 0;
     minNmpPly = 0;
 }
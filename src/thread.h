@@ -18,6 +18,7 @@ struct ThreadInfo {
     array<array<array<array<i32, 64>, 6>, 6>, 2> capthist;
 
     Stack<AccumulatorPair, MAX_PLY + 1> accumulatorStack;
+    RefreshCache                        refreshCache;
 
     ThreadType type;
 
@@ -26,6 +27,9 @@ struct ThreadInfo {
 
     std::atomic<u64> nodes;
     std::atomic<u64> tbHits;
+#ifdef TT_STATS
+    TTStats ttStats;
+#endif
     usize            seldepth;
     i32              minRootScore;
     i32              maxRootScore;
@@ -68,6 +72,9 @@ struct ThreadInfo {
     ThreadStackManager makeMove(Board& board, Board& newBoard, Move m);
     ThreadStackManager makeNullMove(Board& newBoard);
 
+    // Brings the accumulators of the current position up to date and returns them
+    const AccumulatorPair& accumulators();
+
     void refresh(Board& b);
 
     void reset();
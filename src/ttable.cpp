@@ -0,0 +1,257 @@
+#include "ttable.h"
+
+#include <chrono>
+#include <fstream>
+
+namespace {
+constexpr array<char, 8> HASH_FILE_MAGIC   = {'P', 'R', 'L', 'D', 'H', 'A', 'S', 'H'};
+constexpr u32            HASH_FILE_VERSION = 4;
+
+struct HashFileHeader {
+    array<char, 8> magic;
+    u32            version;
+    u32            entrySize;
+    u32            clusterSize;
+    u32            age;
+    u32            epochStart;
+    u32            salt;
+    u64            clusters;
+};
+
+constexpr u64 SHARED_HASH_MAGIC = 0x485341484C525053;  // "SPRLHASH"
+
+// Sits in front of the clusters of a shared segment. A fresh segment is zero filled, which is already an empty table
+struct alignas(64) SharedHashHeader {
+    std::atomic<u64> magic;
+    u64              clusters;
+    std::atomic<u8>  age;
+};
+
+static_assert(std::atomic<u64>::is_always_lock_free && std::atomic<u8>::is_always_lock_free, "Shared hash atomics must be address free");
+}
+
+bool TranspositionTable::share(const string& name, usize threadCount) {
+    if (name.empty() || name == "<empty>") {
+        if (sharedAge == nullptr)
+            return true;
+
+        sharedAge = nullptr;
+        reserve(std::max<usize>(size * sizeof(TTCluster) / 1024 / 1024, 1));
+        wipe(threadCount);
+        age        = 0;
+        epoch      = 0;
+        salt       = 0;
+        epochStart = 0;
+        cout << "info string Hash is private again" << endl;
+        return true;
+    }
+
+    bool               created = false;
+    Memory::Allocation segment = Memory::openShared(name, sizeof(SharedHashHeader) + size * sizeof(TTCluster), created);
+    if (segment.ptr == nullptr) {
+        cout << "info string Could not open shared hash " << name << endl;
+        return false;
+    }
+
+    SharedHashHeader* header = static_cast<SharedHashHeader*>(segment.ptr);
+    if (created) {
+        header->clusters = size;
+        header->magic.store(SHARED_HASH_MAGIC, std::memory_order_release);
+    }
+    else {
+        // The creator may not have filled in the header yet
+        for (usize attempt = 0; attempt < 1000 && header->magic.load(std::memory_order_acquire) != SHARED_HASH_MAGIC; attempt++)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+        if (header->magic.load(std::memory_order_acquire) != SHARED_HASH_MAGIC || segment.bytes < sizeof(SharedHashHeader) + header->clusters * sizeof(TTCluster)) {
+            cout << "info string Rejected shared hash " << name << ": not a Prelude hash of this version" << endl;
+            Memory::free(segment);
+            return false;
+        }
+    }
+
+    Memory::free(memory);
+    memory     = segment;
+    table      = reinterpret_cast<TTCluster*>(header + 1);
+    size       = header->clusters;
+    sharedAge  = &header->age;
+    age        = sharedAge->load(std::memory_order_relaxed);
+    epoch      = 0;
+    salt       = 0;
+    epochStart = 0;
+
+    cout << "info string " << (created ? "Created" : "Attached to") << " shared hash " << name << " of " << size * sizeof(TTCluster) / 1024 / 1024 << "MB" << endl;
+    return true;
+}
+
+void TranspositionTable::resize(usize newSizeMiB, usize threadCount) {
+    assert(newSizeMiB > 0);
+    assert(threadCount > 0);
+    assert(sharedAge == nullptr);
+
+    const u64 newSize = newSizeMiB * 1024 * 1024 / sizeof(TTCluster);
+    if (newSize == size)
+        return;
+
+    Memory::Allocation newMemory = Memory::allocateLarge(newSize * sizeof(TTCluster));
+    TTCluster*         newTable  = static_cast<TTCluster*>(newMemory.ptr);
+    if (newMemory.mapped)
+        Numa::interleave(newMemory.ptr, newMemory.bytes);
+
+    std::vector<std::thread> threads;
+
+    // Each thread fills a range of new clusters, so no two threads write the same line and every page
+    // is first touched by the thread that migrates into it
+    auto migrateSegment = [&](usize threadId) {
+        usize start = (newSize * threadId) / threadCount;
+        usize end   = std::min((newSize * (threadId + 1)) / threadCount, newSize);
+
+        for (usize dest = start; dest < end; dest++) {
+            std::memset(static_cast<void*>(newTable + dest), 0, sizeof(TTCluster));
+
+            // index() maps keys in order, so the old clusters whose key range overlaps this one are contiguous.
+            // Only a fragment of the key is stored, so an entry from an old cluster on a boundary can't be placed
+            // exactly and is offered to every new cluster it may belong to
+            const u64 first = static_cast<u64>(static_cast<u128>(dest) * size / newSize);
+            const u64 last  = static_cast<u64>((static_cast<u128>(dest + 1) * size - 1) / newSize);
+
+            array<Transposition, TT_CLUSTER_SIZE> kept;
+            usize                                 keptCount = 0;
+
+            for (u64 source = first; source <= last; source++) {
+                for (usize slot = 0; slot < TT_CLUSTER_SIZE; slot++) {
+                    const Transposition entry = table[source].load(slot);
+                    if (!current(entry))
+                        continue;
+
+                    if (keptCount < TT_CLUSTER_SIZE) {
+                        kept[keptCount++] = entry;
+                        continue;
+                    }
+
+                    // Keep the deepest entries, discounted by age the same way victims are picked
+                    usize weakest = 0;
+                    for (usize i = 1; i < TT_CLUSTER_SIZE; i++)
+                        if (worth(kept[i]) < worth(kept[weakest]))
+                            weakest = i;
+                    if (worth(entry) > worth(kept[weakest]))
+                        kept[weakest] = entry;
+                }
+            }
+
+            // Entries keep their salted fragment, so they stay valid in the current epoch. Growing offers an entry to
+            // several clusters, so the copies are aged just outside the window: probes still find them, but they count
+            // as free slots for victim choice and hashfull instead of filling the table with duplicates
+            for (usize slot = 0; slot < keptCount; slot++) {
+                if (newSize > size)
+                    kept[slot].age = (epochStart - 1) & TT_AGE_MASK;
+                newTable[dest].store(slot, kept[slot]);
+            }
+        }
+    };
+
+    for (usize thread = 1; thread < threadCount; thread++)
+        threads.emplace_back(migrateSegment, thread);
+
+    migrateSegment(0);
+
+    for (std::thread& t : threads)
+        if (t.joinable())
+            t.join();
+
+    Memory::free(memory);
+    memory = newMemory;
+    table  = newTable;
+    size   = newSize;
+}
+
+bool TranspositionTable::save(const string& path) const {
+    if (path.empty() || path == "<empty>") {
+        cout << "info string No hash file given, pass one to savehash or set HashFile" << endl;
+        return false;
+    }
+
+    std::ofstream stream(path, std::ios::binary | std::ios::trunc);
+    if (!stream.is_open()) {
+        cout << "info string Could not open " << path << " to save the hash" << endl;
+        return false;
+    }
+
+    const HashFileHeader header{HASH_FILE_MAGIC, HASH_FILE_VERSION, TT_ENTRY_BYTES, TT_CLUSTER_SIZE, age, epochStart, salt, size};
+
+    stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    stream.write(reinterpret_cast<const char*>(table), size * sizeof(TTCluster));
+
+    if (!stream) {
+        cout << "info string Failed while writing the hash to " << path << endl;
+        return false;
+    }
+
+    cout << "info string Saved " << size * sizeof(TTCluster) / 1024 / 1024 << "MB of hash to " << path << endl;
+    return true;
+}
+
+bool TranspositionTable::load(const string& path, usize threadCount) {
+    assert(threadCount > 0);
+
+    if (path.empty() || path == "<empty>") {
+        cout << "info string No hash file given, pass one to loadhash or set HashFile" << endl;
+        return false;
+    }
+
+    const Memory::MappedFile file(path);
+    if (!file.isOpen()) {
+        cout << "info string Could not open " << path << " to load the hash" << endl;
+        return false;
+    }
+
+    auto reject = [&](const string& reason) {
+        cout << "info string Rejected hash file " << path << ": " << reason << endl;
+        return false;
+    };
+
+    if (sharedAge != nullptr)
+        return reject("the hash is shared with other processes");
+    if (file.size() < sizeof(HashFileHeader))
+        return reject("file is too small");
+
+    HashFileHeader header;
+    std::memcpy(&header, file.data(), sizeof(header));
+
+    if (header.magic != HASH_FILE_MAGIC || header.version != HASH_FILE_VERSION)
+        return reject("not a Prelude hash file of this version");
+    if (header.entrySize != TT_ENTRY_BYTES || header.clusterSize != TT_CLUSTER_SIZE)
+        return reject("entry layout differs from this build");
+    if (header.clusters != size)
+        return reject("hash size differs, set Hash to " + std::to_string(header.clusters * sizeof(TTCluster) / 1024 / 1024) + " first");
+    if (file.size() != sizeof(HashFileHeader) + size * sizeof(TTCluster))
+        return reject("file is truncated");
+
+    const u8* clusters = file.data() + sizeof(HashFileHeader);
+
+    // Copy in parallel so the pages of the mapping are read in at the bandwidth of several cores
+    std::vector<std::thread> threads;
+
+    auto loadSegment = [&](usize threadId) {
+        usize start = (size * threadId) / threadCount;
+        usize end   = std::min((size * (threadId + 1)) / threadCount, size);
+
+        std::memcpy(static_cast<void*>(table + start), clusters + start * sizeof(TTCluster), (end - start) * sizeof(TTCluster));
+    };
+
+    for (usize thread = 1; thread < threadCount; thread++)
+        threads.emplace_back(loadSegment, thread);
+
+    loadSegment(0);
+
+    for (std::thread& t : threads)
+        if (t.joinable())
+            t.join();
+
+    age        = header.age;
+    epochStart = header.epochStart;
+    salt       = header.salt;
+
+    cout << "info string Loaded " << size * sizeof(TTCluster) / 1024 / 1024 << "MB of hash from " << path << endl;
+    return true;
+}
@@ -2,57 +2,191 @@
 
 #include "types.h"
 #include "move.h"
+#include "config.h"
+#include "constants.h"
+#include "memory.h"
+#include "numa.h"
 
+#include <bit>
+#include <atomic>
 #include <vector>
 #include <thread>
 #include <cstring>
 
+// Only the low bits of the key are stored, the cluster index already encodes most of the rest
+constexpr u64 TT_KEY_MASK = 0xFFFF;
+constexpr u8  TT_AGE_MASK = 0b111111;
+// Stored when the position was never evaluated, evaluate() is clamped well inside this
+constexpr i16 TT_NO_EVAL = std::numeric_limits<i16>::min();
+
 struct Transposition {
+    // The full key when returned from the table, only the stored fragment while packed
     u64  zobrist;
     Move move;
     i16  score;
+    i16  staticEval;
     u8   flag;
     u8   depth;
     u8   age;
 
     Transposition() {
-        zobrist = 0;
-        move    = Move();
-        flag    = 0;
-        score   = 0;
-        depth   = 0;
-        age     = 0;
-    }
-    Transposition(u64 zobristKey, Move bestMove, u8 flag, i16 score, u8 depth) {
-        this->zobrist = zobristKey;
-        this->move    = bestMove;
-        this->flag    = flag;
-        this->score   = score;
-        this->depth   = depth;
-        age           = 0;
+        zobrist    = 0;
+        move       = Move();
+        flag       = 0;
+        score      = 0;
+        staticEval = TT_NO_EVAL;
+        depth      = 0;
+        age        = 0;
+    }
+    Transposition(u64 zobristKey, Move bestMove, u8 flag, i16 score, u8 depth, i16 staticEval = TT_NO_EVAL) {
+        this->zobrist    = zobristKey;
+        this->move       = bestMove;
+        this->flag       = flag;
+        this->score      = score;
+        this->depth      = depth;
+        this->staticEval = staticEval;
+        age              = 0;
+    }
+
+    // Packed as key fragment | move << 16 | score << 32 | depth << 48 | flag << 56 | age << 58
+    // The static eval lives in a separate word, so the key fragment is xored with it to catch an eval from another store
+    u64 pack() const {
+        return ((zobrist ^ static_cast<u16>(staticEval)) & TT_KEY_MASK) | static_cast<u64>(std::bit_cast<u16>(move)) << 16 | static_cast<u64>(static_cast<u16>(score)) << 32
+             | static_cast<u64>(depth) << 48 | static_cast<u64>(flag & 0b11) << 56 | static_cast<u64>(age & TT_AGE_MASK) << 58;
+    }
+
+    static Transposition unpack(u64 data, i16 eval) {
+        Transposition entry;
+        entry.zobrist    = (data ^ static_cast<u16>(eval)) & TT_KEY_MASK;
+        entry.move       = std::bit_cast<Move>(static_cast<u16>(data >> 16));
+        entry.score      = static_cast<i16>(data >> 32);
+        entry.staticEval = eval;
+        entry.depth      = static_cast<u8>(data >> 48);
+        entry.flag       = static_cast<u8>(data >> 56) & 0b11;
+        entry.age        = static_cast<u8>(data >> 58);
+        return entry;
+    }
+
+    // Empty slots unpack to UNDEFINED, so they never match even a key whose fragment is zero
+    bool matches(u64 key) const { return flag != UNDEFINED && zobrist == (key & TT_KEY_MASK); }
+};
+
+#ifdef TT_STATS
+struct TTStats {
+    u64 probes     = 0;
+    u64 hits       = 0;
+    u64 collisions = 0;  // Misses where every slot of the cluster held another position
+    u64 refused    = 0;  // Stores rejected by shouldReplace()
+    u64 cutoffs    = 0;
+
+    TTStats& operator+=(const TTStats& other) {
+        probes += other.probes;
+        hits += other.hits;
+        collisions += other.collisions;
+        refused += other.refused;
+        cutoffs += other.cutoffs;
+        return *this;
     }
 };
 
+    #define TT_STAT(thread, counter) ((thread).ttStats.counter++)
+#else
+    #define TT_STAT(thread, counter) ((void) 0)
+#endif
+
+// Number of entries sharing one index, sized so a cluster fills a cache line
+constexpr usize TT_CLUSTER_SIZE = 6;
+// Bytes of table memory each entry takes up
+constexpr usize TT_ENTRY_BYTES = sizeof(u64) + sizeof(i16);
+// How many plies of depth one search of age is worth when picking a victim
+constexpr i32 TT_AGE_WEIGHT = 8;
+
+// Entries are shared by every search thread without locking. Each is a packed atomic word plus an atomic eval,
+// so a reader sees a whole word from one store, and an eval from a different store fails the key check
+struct alignas(64) TTCluster {
+    array<std::atomic<u64>, TT_CLUSTER_SIZE> data;
+    array<std::atomic<i16>, TT_CLUSTER_SIZE> evals;
+
+    Transposition load(usize slot) const { return Transposition::unpack(data[slot].load(std::memory_order_relaxed), evals[slot].load(std::memory_order_relaxed)); }
+
+    void store(usize slot, const Transposition& entry) {
+        evals[slot].store(entry.staticEval, std::memory_order_relaxed);
+        data[slot].store(entry.pack(), std::memory_order_relaxed);
+    }
+};
+
+static_assert(sizeof(TTCluster) == 64, "TT clusters must fill exactly one cache line");
+
 class TranspositionTable {
-    Transposition* table;
-    u8             age;
+    TTCluster*         table;
+    Memory::Allocation memory;
+    u8                 age;
+
+    // Clearing starts a new epoch instead of touching memory. Keys are salted per epoch so older entries
+    // stop matching, and entries aged before the epoch started are treated as free slots
+    u16 epoch;
+    u16 salt;
+    u8  epochStart;
+
+    // Set while the table lives in a shared memory segment. Every process then steps the same age, and there are no epochs
+    std::atomic<u8>* sharedAge;
+
+    // Entries from before the last clear carry another salt, so probes reject them by key alone and any filled slot may be used
+    bool live(const Transposition& entry) const { return entry.flag != UNDEFINED; }
+
+    // Whether an entry counts as occupying its slot. Entries aged before the epoch started, or so long ago that the window
+    // has slid past them, are only given up first when replacing and left out of hashfull, they can still be probed
+    bool current(const Transposition& entry) const {
+        if (!live(entry))
+            return false;
+        // Another process may already be on a later age than this one
+        if (sharedAge != nullptr)
+            return true;
+        return ((entry.age - epochStart) & TT_AGE_MASK) <= ((age - epochStart) & TT_AGE_MASK);
+    }
+
+    u64 saltedKey(u64 key) const { return key ^ salt; }
+
+    // Lower is a better replacement candidate, empty and stale slots go first
+    i32 worth(const Transposition& entry) const {
+        if (!current(entry))
+            return -INF_INT;
+        const i32 relativeAge = (age - entry.age) & TT_AGE_MASK;
+        // Entries from a later age than ours can only come from another process, they are as fresh as ours
+        return entry.depth - TT_AGE_WEIGHT * (relativeAge > TT_AGE_MASK / 2 ? 0 : relativeAge);
+    }
 
    public:
+    // Number of clusters in the table
     u64 size;
 
     TranspositionTable(usize sizeInMB = 16) {
-        table = nullptr;
-        age   = 0;
+        table      = nullptr;
+        age        = 0;
+        epoch      = 0;
+        salt       = 0;
+        epochStart = 0;
+        sharedAge  = nullptr;
         reserve(sizeInMB);
+        wipe();
     }
 
-    ~TranspositionTable() {
-        if (table != nullptr)
-            std::free(table);
-    }
+    ~TranspositionTable() { Memory::free(memory); }
+
 
+    // Empties the table in O(1) by starting a new epoch. A shared table is left alone, other processes are still using it
+    void clear() {
+        if (sharedAge != nullptr)
+            return;
+        age++;
+        epochStart = age & TT_AGE_MASK;
+        epoch++;
+        // Odd multiplier, so every epoch until the counter wraps gets a distinct salt
+        salt = static_cast<u16>(epoch * 0x9E37);
+    }
 
-    void clear(usize threadCount = 1) {
+    // Zeroes every cluster. After reserve() this is also the first touch that places the pages
+    void wipe(usize threadCount = 1) {
         assert(threadCount > 0);
 
         std::vector<std::thread> threads;
@@ -65,7 +199,7 @@ class TranspositionTable {
             usize start = (size * threadId) / threadCount;
             usize end   = std::min((size * (threadId + 1)) / threadCount, size);
 
-            std::memset(table + start, 0, (end - start) * sizeof(Transposition));
+            std::memset(static_cast<void*>(table + start), 0, (end - start) * sizeof(TTCluster));
         };
 
         for (usize thread = 1; thread < threadCount; thread++)
@@ -81,36 +215,105 @@ class TranspositionTable {
     void reserve(usize newSizeMiB) {
         assert(newSizeMiB > 0);
         // Find number of bytes allowed
-        size = newSizeMiB * 1024 * 1024 / sizeof(Transposition);
-        if (table != nullptr)
-            std::free(table);
-        table = static_cast<Transposition*>(std::malloc(size * sizeof(Transposition)));
+        size = newSizeMiB * 1024 * 1024 / sizeof(TTCluster);
+        Memory::free(memory);
+        // Nothing is written here, the pages get placed when wipe() first touches them
+        memory = Memory::allocateLarge(size * sizeof(TTCluster));
+        table  = static_cast<TTCluster*>(memory.ptr);
+        // Every thread probes the whole table, so spread it over all nodes rather than the one that touched it
+        if (memory.mapped)
+            Numa::interleave(memory.ptr, memory.bytes);
     }
 
-    u64 index(u64 key) {
+    // Attaches to the named shared memory segment, creating it with the current size if needed, so several
+    // processes search with one table. An empty name goes back to a private table
+    bool share(const string& name, usize threadCount = 1);
+    bool isShared() const { return sharedAge != nullptr; }
+
+    // Moves to a table of the new size, carrying the live entries over instead of discarding them
+    void resize(usize newSizeMiB, usize threadCount = 1);
+
+    string describePages() const { return Memory::describePages(memory); }
+
+    // Dumps the table to disk so a later session can continue from it. Both print an info string with the result
+    bool save(const string& path) const;
+    // Only accepts files written by a table with the same entry layout and size
+    bool load(const string& path, usize threadCount = 1);
+
+    u64 index(u64 key) const {
         return static_cast<u64>((static_cast<u128>(key) * static_cast<u128>(size)) >> 64);
     }
 
-    void prefetch(u64 key) { __builtin_prefetch(this->getEntry(key)); }
+    void prefetch(u64 key) { __builtin_prefetch(&table[index(key)]); }
+
+    // Returns the slot holding the key, or the slot in its cluster that should be overwritten if none do
+    usize findSlot(const TTCluster& cluster, u64 key) const {
+        usize victim      = 0;
+        i32   victimWorth = INF_INT;
+
+        for (usize slot = 0; slot < TT_CLUSTER_SIZE; slot++) {
+            const Transposition entry = cluster.load(slot);
+            if (entry.matches(saltedKey(key)) && live(entry))
+                return slot;
+            if (worth(entry) < victimWorth) {
+                victim      = slot;
+                victimWorth = worth(entry);
+            }
+        }
+
+        return victim;
+    }
+
+    void setEntry(u64 key, Transposition entry) {
+        TTCluster& cluster = table[index(key)];
+        entry.zobrist      = saltedKey(key);
+        entry.age          = age;
+        cluster.store(findSlot(cluster, key), entry);
+    }
 
-    void setEntry(u64 key, Transposition& entry) {
-        entry.age         = age;
-        table[index(key)] = entry;
+    bool clusterFull(u64 key) const {
+        const TTCluster& cluster = table[index(key)];
+        for (usize slot = 0; slot < TT_CLUSTER_SIZE; slot++)
+            if (!current(cluster.load(slot)))
+                return false;
+        return true;
     }
 
-    Transposition* getEntry(u64 key) { return &table[index(key)]; }
+    // Returns a snapshot of the entry for the key, or an empty entry (with a zobrist that won't match) on a miss
+    Transposition getEntry(u64 key) {
+        const TTCluster& cluster = table[index(key)];
+        for (usize slot = 0; slot < TT_CLUSTER_SIZE; slot++) {
+            Transposition entry = cluster.load(slot);
+            if (entry.matches(saltedKey(key)) && live(entry)) {
+                entry.zobrist = key;
+                return entry;
+            }
+        }
+        return Transposition();
+    }
 
-    void updateAge() { age++; }
+    void updateAge() {
+        if (sharedAge != nullptr) {
+            age = sharedAge->fetch_add(1, std::memory_order_relaxed) + 1;
+            return;
+        }
+        age++;
+        // Slide the window along, otherwise a long session without a clear would wrap the age around to the epoch start
+        // This only decides which entries are replaced first, probes still find the older ones
+        if (((age - epochStart) & TT_AGE_MASK) > TT_AGE_MASK / 2)
+            epochStart = (age - TT_AGE_MASK / 2) & TT_AGE_MASK;
+    }
 
     bool shouldReplace(const Transposition& entry, const Transposition& newEntry) const {
-        return newEntry.flag == EXACT || newEntry.zobrist != entry.zobrist || newEntry.age != entry.age || newEntry.depth < entry.depth + 4;
+        // New entries are only stamped with the age in setEntry(), so compare against the table's age
+        return newEntry.flag == EXACT || newEntry.zobrist != entry.zobrist || entry.age != (age & TT_AGE_MASK) || newEntry.depth < entry.depth + 4;
     }
 
     usize hashfull() {
-        usize samples = std::min((u64) 1000, size);
+        usize samples = std::min((u64) 1000 / TT_CLUSTER_SIZE, size) * TT_CLUSTER_SIZE;
         usize hits    = 0;
         for (usize sample = 0; sample < samples; sample++)
-            hits += table[sample].zobrist != 0;
+            hits += current(table[sample / TT_CLUSTER_SIZE].load(sample % TT_CLUSTER_SIZE));
         usize hash = (int) (hits / (double) samples * 1000);
         assert(hash <= 1000);
         return hash;
@@ -18,6 +18,7 @@ using u8  = uint8_t;
 using i64 = int64_t;
 using i32 = int32_t;
 using i16 = int16_t;
+using i8  = int8_t;
 
 #ifdef _MSC_VER
     #include <__msvc_int128.hpp>
@@ -199,6 +200,16 @@ class Stack {
           assert(ptr > 0);
           return underlying[ptr - 1];
       }
+      // Pushes the next slot as it is, for callers that overwrite it themselves instead of copying in a whole element
+      Type& pushUninitialized() {
+          assert(ptr < size);
+          return underlying[ptr++];
+      }
+      usize length() const { return ptr; }
+      Type& operator[](usize idx) {
+          assert(idx < ptr);
+          return underlying[idx];
+      }
       void clear() {
           ptr = 0;
       }